@@ -0,0 +1,44 @@
+#include "Benchmark.h"
+#include <iostream>
+#include <iomanip>
+
+namespace
+{
+	volatile U64 sink;
+}
+
+Benchmark::Benchmark(int warmup, int repetitions, const std::string& filter) : warmup(warmup), repetitions(repetitions), filter(filter)
+{
+}
+
+void Benchmark::keep(U64 value)
+{
+	sink = sink + value;
+}
+
+Benchmark::Result Benchmark::summarise(const std::string& name, std::vector<double>& samples)
+{
+	std::sort(samples.begin(), samples.end());
+
+	auto percentile = [&](double p) { return samples[std::min(samples.size() - 1, size_t(p * double(samples.size() - 1) + 0.5))]; };
+
+	return Result{ name, samples.front(), percentile(0.5), percentile(0.9), percentile(0.99), int(samples.size()) };
+}
+
+void Benchmark::print_header()
+{
+	std::cout << std::left << std::setw(40) << "benchmark" << std::right
+		<< std::setw(12) << "min ns" << std::setw(12) << "median ns" << std::setw(12) << "p90 ns" << std::setw(12) << "p99 ns" << '\n';
+}
+
+void Benchmark::print(const Result& result)
+{
+	std::cout << std::left << std::setw(40) << result.name << std::right << std::fixed << std::setprecision(2)
+		<< std::setw(12) << result.min_ns << std::setw(12) << result.median_ns << std::setw(12) << result.p90_ns << std::setw(12) << result.p99_ns << '\n';
+}
+
+void Benchmark::print_ratio(const Result& baseline, const Result& candidate)
+{
+	std::cout << std::left << std::setw(40) << "  median speedup" << std::right << std::fixed << std::setprecision(2)
+		<< std::setw(12) << baseline.median_ns / candidate.median_ns << "x\n";
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+typedef unsigned long long U64;
+
+// Minimal micro-benchmark harness: every case is run for a few warmup rounds,
+// then timed over a number of repetitions; the per-call times of all
+// repetitions are summarised as min/median/percentiles.
+class Benchmark
+{
+public:
+	struct Result
+	{
+		std::string name;
+		double min_ns;
+		double median_ns;
+		double p90_ns;
+		double p99_ns;
+		int repetitions;
+	};
+
+	Benchmark(int warmup = 3, int repetitions = 31, const std::string& filter = "");
+
+	// body() performs calls_per_run calls of the measured primitive and returns a value that depends on them
+	template<typename Body>
+	Result run(const std::string& name, long long calls_per_run, Body body)
+	{
+		std::vector<double> samples;
+		samples.reserve(repetitions);
+
+		for (int i = 0; i < warmup; i++) keep(body());
+
+		for (int i = 0; i < repetitions; i++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			keep(body());
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / double(calls_per_run));
+		}
+
+		return summarise(name, samples);
+	}
+
+	// runs both implementations of one primitive back to back and prints them side by side
+	template<typename BodyA, typename BodyB>
+	void compare(const std::string& group, const std::string& name_a, BodyA a, const std::string& name_b, BodyB b, long long calls_per_run)
+	{
+		if (!selected(group)) return;
+
+		Result result_a = run(group + "/" + name_a, calls_per_run, a);
+		Result result_b = run(group + "/" + name_b, calls_per_run, b);
+
+		print(result_a);
+		print(result_b);
+		print_ratio(result_a, result_b);
+	}
+
+	template<typename Body>
+	void single(const std::string& group, const std::string& name, Body body, long long calls_per_run)
+	{
+		if (!selected(group)) return;
+
+		print(run(group + "/" + name, calls_per_run, body));
+	}
+
+	static void print_header();
+	static void print(const Result& result);
+	static void print_ratio(const Result& baseline, const Result& candidate);
+
+private:
+	int warmup;
+	int repetitions;
+	std::string filter;
+
+	bool selected(const std::string& group) const { return filter.empty() || group.find(filter) != std::string::npos; }
+
+	static Result summarise(const std::string& name, std::vector<double>& samples);
+
+	// stops the optimiser from discarding the measured work
+	static void keep(U64 value);
+};
@@ -0,0 +1,262 @@
+#include "Benchmark.h"
+#include "../BitboardChess/ChessGame.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	// opening, middlegame and endgame positions used by every case
+	const char* const corpus_fens[]
+	{
+		"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+		"r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+		"r1bq1rk1/pp2bppp/2n1pn2/2pp4/3P4/2PBPN2/PP1N1PPP/R1BQ1RK1 w - - 0 8",
+		"r2q1rk1/1b1nbppp/p2ppn2/1p6/3NP3/1BN1BP2/PPPQ2PP/2KR3R w - - 2 12",
+		"1rb2r1k/4bpRp/p2p4/3N1P1P/n2BP3/P3qP2/1PPpR3/1K5 w - - 0 24",
+		"2r2rk1/pp3ppp/2n1b3/q2pP3/3P4/P1PB1N2/5PPP/R2Q1RK1 b - - 0 16",
+		"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		"6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+		"8/8/4k3/8/2p5/8/B2K4/8 w - - 0 1",
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19"
+	};
+
+	const int runs_per_case = 2000;
+
+	std::vector<ChessGame::Position> positions;
+	std::vector<U64> bitboards;
+
+	// every legal move of every corpus position
+	struct PositionMove
+	{
+		size_t position;
+		ChessGame::Move move;
+	};
+	std::vector<PositionMove> moves;
+
+#ifdef CHESS_QUAD_BITBOARDS
+	const char* const layout_name = "quad";
+#else
+	const char* const layout_name = "bitboards";
+#endif
+
+	// the 64-bit MSVC intrinsics only exist on x64; Win32 scans the two halves
+	inline int hardware_bit_scan_forward(U64 bitboard)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		return _BitScanForward64(&index, bitboard) ? int(index) : -1;
+#elif defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanForward(&index, (unsigned long)bitboard)) return int(index);
+		return _BitScanForward(&index, (unsigned long)(bitboard >> 32)) ? int(index) + 32 : -1;
+#else
+		return bitboard ? __builtin_ctzll(bitboard) : -1;
+#endif
+	}
+
+	inline int hardware_bit_scan_reverse(U64 bitboard)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanReverse64(&index, bitboard);
+		return int(index);
+#elif defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanReverse(&index, (unsigned long)(bitboard >> 32))) return int(index) + 32;
+		_BitScanReverse(&index, (unsigned long)bitboard);
+		return int(index);
+#else
+		return 63 - __builtin_clzll(bitboard);
+#endif
+	}
+
+	inline int hardware_pop_count(U64 bitboard)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		return int(__popcnt64(bitboard));
+#elif defined(_MSC_VER)
+		return int(__popcnt((unsigned int)bitboard) + __popcnt((unsigned int)(bitboard >> 32)));
+#else
+		return __builtin_popcountll(bitboard);
+#endif
+	}
+
+	// attack map built the way attacks() did before the set-wise fills
+	U64 per_piece_attacks(ChessGame::Position position, bool is_black)
+	{
+		return ChessGame::mask_pawn_attacks(position, is_black)
+			| ChessGame::rook_moves(position, is_black)
+			| ChessGame::knight_attack_set(position.pieces(ChessGame::nKnight) & position.pieces(is_black))
+			| ChessGame::bishop_moves(position, is_black)
+			| ChessGame::queen_moves(position, is_black)
+			| ChessGame::king_mask(ChessGame::bit_scan_forward(position.pieces(ChessGame::nKing) & position.pieces(is_black)));
+	}
+
+	U64 diagonal_table[64];
+
+	// runs fn(position, square) for every square of every corpus position
+	template<typename Fn>
+	U64 for_each_square(Fn fn)
+	{
+		U64 sum = 0;
+		for (int run = 0; run < runs_per_case / 10; run++)
+		{
+			for (const ChessGame::Position& position : positions)
+			{
+				for (int square = 0; square < 64; square++) sum += fn(position, square);
+			}
+		}
+		return sum;
+	}
+
+	template<typename Fn>
+	U64 for_each_bitboard(Fn fn)
+	{
+		U64 sum = 0;
+		for (int run = 0; run < runs_per_case; run++)
+		{
+			for (U64 bitboard : bitboards) sum += U64(fn(bitboard));
+		}
+		return sum;
+	}
+
+	template<typename Fn>
+	U64 for_each_position(Fn fn)
+	{
+		U64 sum = 0;
+		for (int run = 0; run < runs_per_case; run++)
+		{
+			for (const ChessGame::Position& position : positions) sum += fn(position);
+		}
+		return sum;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::string filter = argc > 1 ? argv[1] : "";
+	int repetitions = argc > 2 ? std::atoi(argv[2]) : 31;
+
+	for (const char* fen : corpus_fens)
+	{
+		ChessGame::Position position = ChessGame::fen_to_pos(fen);
+		positions.push_back(position);
+		U64 sets[8];
+		position.bitboards(sets);
+		for (U64 bitboard : sets)
+		{
+			if (bitboard) bitboards.push_back(bitboard);
+		}
+		if (~position.empty_squares()) bitboards.push_back(~position.empty_squares());
+
+		ChessGame::MoveList list;
+		ChessGame::generate_moves(position, list);
+		for (int i = 0; i < list.count; i++) moves.push_back(PositionMove{ positions.size() - 1, list.moves[i] });
+	}
+
+	for (int square = 0; square < 64; square++) diagonal_table[square] = ChessGame::diagonal_mask(square);
+
+	long long bitboard_calls = (long long)runs_per_case * bitboards.size();
+	long long square_calls = (long long)(runs_per_case / 10) * positions.size() * 64;
+	long long position_calls = (long long)runs_per_case * positions.size();
+
+	Benchmark bench(3, repetitions, filter);
+	Benchmark::print_header();
+
+	bench.compare("bit_scan_forward",
+		"de_bruijn", [] { return for_each_bitboard(ChessGame::bit_scan_forward); },
+		"hardware", [] { return for_each_bitboard(hardware_bit_scan_forward); },
+		bitboard_calls);
+
+	bench.compare("bit_scan_reverse",
+		"de_bruijn", [] { return for_each_bitboard(ChessGame::bit_scan_reverse); },
+		"hardware", [] { return for_each_bitboard(hardware_bit_scan_reverse); },
+		bitboard_calls);
+
+	bench.compare("pop_count",
+		"loop", [] { return for_each_bitboard(ChessGame::pop_count); },
+		"hardware", [] { return for_each_bitboard(hardware_pop_count); },
+		bitboard_calls);
+
+	bench.compare("rook_moves_mask",
+		"ray_loop", [] { return for_each_square([](const ChessGame::Position& position, int square) { return ChessGame::rook_moves_mask(square, position, false); }); },
+		"kogge_stone", [] { return for_each_square([](const ChessGame::Position& position, int square) { return ChessGame::sliding_attacks(1ULL << square, 0ULL, position.empty_squares()); }); },
+		square_calls);
+
+	bench.compare("bishop_moves_mask",
+		"ray_loop", [] { return for_each_square([](const ChessGame::Position& position, int square) { return ChessGame::bishop_moves_mask(square, position, false); }); },
+		"kogge_stone", [] { return for_each_square([](const ChessGame::Position& position, int square) { return ChessGame::sliding_attacks(0ULL, 1ULL << square, position.empty_squares()); }); },
+		square_calls);
+
+	bench.compare("diagonal_mask",
+		"computed", [] { return for_each_square([](const ChessGame::Position&, int square) { return ChessGame::diagonal_mask(square); }); },
+		"table", [] { return for_each_square([](const ChessGame::Position&, int square) { return diagonal_table[square]; }); },
+		square_calls);
+
+	bench.compare("attacks",
+		"per_piece", [] { return for_each_position([](const ChessGame::Position& position) { return per_piece_attacks(position, false) ^ per_piece_attacks(position, true); }); },
+		"set_wise", [] { return for_each_position([](const ChessGame::Position& position) { return ChessGame::attacks(position, false) ^ ChessGame::attacks(position, true); }); },
+		position_calls * 2);
+
+	bench.compare("legal_move_exists",
+		"generate", [] { return for_each_position([](const ChessGame::Position& position) {
+			ChessGame::MoveList list;
+			ChessGame::generate_moves(position, list);
+			return U64(list.count > 0);
+		}); },
+		"early_exit", [] { return for_each_position([](const ChessGame::Position& position) { return U64(ChessGame::has_legal_move(position)); }); },
+		position_calls);
+
+	bench.single("fen_to_pos", "stringstream", [] {
+		U64 sum = 0;
+		for (int run = 0; run < runs_per_case / 10; run++)
+		{
+			for (const char* fen : corpus_fens) sum += ChessGame::fen_to_pos(fen).empty_squares();
+		}
+		return sum;
+	}, (long long)(runs_per_case / 10) * positions.size());
+
+	// the position layout is chosen at compile time: build once with and once without
+	// CHESS_QUAD_BITBOARDS and compare these cases between the two runs
+	std::cout << "position layout: " << layout_name << ", sizeof(Position) = " << sizeof(ChessGame::Position) << " bytes\n";
+
+	bench.single("make_move", layout_name, [] {
+		U64 sum = 0;
+		for (int run = 0; run < runs_per_case / 10; run++)
+		{
+			for (const PositionMove& entry : moves)
+			{
+				ChessGame::Position next = positions[entry.position];
+				ChessGame::make_move(next, entry.move.initial_square, entry.move.final_square);
+				sum += next.attack_maps[0] ^ next.pawn_key;
+			}
+		}
+		return sum;
+	}, (long long)(runs_per_case / 10) * moves.size());
+
+	bench.single("piece_sets", layout_name, [] { return for_each_position([](const ChessGame::Position& position) {
+		U64 sets[8];
+		position.bitboards(sets);
+		return sets[0] ^ sets[1] ^ sets[2] ^ sets[3] ^ sets[4] ^ sets[5] ^ sets[6] ^ sets[7];
+	}); }, position_calls);
+
+	bench.single("generate_moves", layout_name, [] { return for_each_position([](const ChessGame::Position& position) {
+		ChessGame::MoveList list;
+		ChessGame::generate_moves(position, list);
+		return U64(list.count);
+	}); }, position_calls);
+
+	bench.compare("position_id",
+		"to_string", [] { return for_each_position([](const ChessGame::Position& position) { return U64(ChessGame::pos_stringid(position).size()); }); },
+		"position_key", [] { return for_each_position([](const ChessGame::Position& position) { return ChessGame::position_key(position); }); },
+		position_calls);
+
+	return 0;
+}
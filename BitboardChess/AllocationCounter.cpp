@@ -0,0 +1,104 @@
+#include "AllocationCounter.h"
+
+#ifdef CHESS_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+namespace
+{
+	std::atomic<unsigned long long> allocations{ 0 };
+
+	void* allocate(std::size_t size)
+	{
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		return std::malloc(size ? size : 1);
+	}
+
+#ifdef __cpp_aligned_new
+	void* allocate_aligned(std::size_t size, std::size_t alignment)
+	{
+		allocations.fetch_add(1, std::memory_order_relaxed);
+#if defined(_MSC_VER)
+		return _aligned_malloc(size ? size : 1, alignment);
+#else
+		// aligned_alloc wants the size rounded up to the alignment
+		return std::aligned_alloc(alignment, ((size ? size : 1) + alignment - 1) / alignment * alignment);
+#endif
+	}
+
+	void release_aligned(void* pointer)
+	{
+#if defined(_MSC_VER)
+		_aligned_free(pointer);
+#else
+		std::free(pointer);
+#endif
+	}
+#endif
+}
+
+void* operator new(std::size_t size)
+{
+	void* pointer = allocate(size);
+	if (!pointer) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](std::size_t size)
+{
+	void* pointer = allocate(size);
+	if (!pointer) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+
+// over-aligned types (the NNUE accumulators) go through these from C++17 on
+#ifdef __cpp_aligned_new
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	void* pointer = allocate_aligned(size, std::size_t(alignment));
+	if (!pointer) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+	void* pointer = allocate_aligned(size, std::size_t(alignment));
+	if (!pointer) throw std::bad_alloc();
+	return pointer;
+}
+#endif
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+#ifdef __cpp_aligned_new
+void operator delete(void* pointer, std::align_val_t) noexcept { release_aligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { release_aligned(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { release_aligned(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { release_aligned(pointer); }
+#endif
+
+unsigned long long AllocationCounter::count()
+{
+	return allocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+unsigned long long AllocationCounter::count()
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+// Heap allocation counter for the allocation-free hot path.
+//
+// Build with CHESS_COUNT_ALLOCATIONS defined to replace the global operator new
+// and delete (plain, array and aligned forms) with versions that count every
+// allocation made by any thread. A check reads count() before and after a run;
+// anything other than zero after initialization is a regression. Without the
+// macro nothing is replaced and count() is always 0.
+class AllocationCounter
+{
+public:
+#ifdef CHESS_COUNT_ALLOCATIONS
+	const static bool enabled = true;
+#else
+	const static bool enabled = false;
+#endif
+
+	static unsigned long long count();
+};
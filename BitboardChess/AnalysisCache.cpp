@@ -0,0 +1,261 @@
+#include "AnalysisCache.h"
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+AnalysisCache::~AnalysisCache()
+{
+	close();
+}
+
+AnalysisCache::enumOpenResult AnalysisCache::open(const std::string& path, int size_mb)
+{
+	close();
+
+	// an existing file is used as it is if its header is complete and of this version
+	bool exists = map(path, 0, MAP_EXISTING);
+	if (exists && mapping_size)
+	{
+		const Header* header = reinterpret_cast<const Header*>(mapping);
+		bool valid = mapping_size >= sizeof(Header) && !std::memcmp(header->magic, "BBAC", 4) && header->version == file_version && header->entry_size == sizeof(Entry) && header->ready == ready_marker;
+		valid = valid && header->entry_count >= U64(bucket_size) && !(header->entry_count & (header->entry_count - 1)) && mapping_size == sizeof(Header) + header->entry_count * sizeof(Entry);
+
+		if (valid)
+		{
+			entry_count = header->entry_count;
+			entries = reinterpret_cast<Entry*>(mapping + sizeof(Header));
+			return OPENED;
+		}
+
+		// only a cache of another version or an unfinished one is rebuilt; any other file is left alone
+		bool ours = mapping_size >= 4 && !std::memcmp(header->magic, "BBAC", 4);
+		unmap();
+		if (!ours) return NOT_A_CACHE;
+	}
+	else if (exists) unmap();
+
+	U64 count = entries_for(size_mb);
+
+	// the new file is all zeros, which is an empty table; the ready marker goes in last
+	if (!map(path, sizeof(Header) + count * sizeof(Entry), exists ? MAP_REPLACE : MAP_NEW)) return CANNOT_MAP;
+
+	Header* header = reinterpret_cast<Header*>(mapping);
+	std::memcpy(header->magic, "BBAC", 4);
+	header->version = file_version;
+	header->entry_size = sizeof(Entry);
+	header->entry_count = count;
+	flush();
+	header->ready = ready_marker;
+	flush();
+
+	entry_count = count;
+	entries = reinterpret_cast<Entry*>(mapping + sizeof(Header));
+	return OPENED;
+}
+
+void AnalysisCache::allocate(int size_mb)
+{
+	close();
+	memory.assign(size_t(entries_for(size_mb)), Entry{});
+	entries = memory.data();
+	entry_count = memory.size();
+}
+
+void AnalysisCache::close()
+{
+	if (mapping)
+	{
+		flush();
+		unmap();
+	}
+	std::vector<Entry>().swap(memory);
+	entries = nullptr;
+	entry_count = 0ULL;
+}
+
+void AnalysisCache::clear()
+{
+	if (entries) std::memset(static_cast<void*>(entries), 0, size_t(entry_count * sizeof(Entry)));
+}
+
+U64 AnalysisCache::entries_for(int size_mb)
+{
+	U64 count = bucket_size;
+	U64 wanted = U64(size_mb > 0 ? size_mb : 1) * 1024 * 1024 / sizeof(Entry);
+	while (count * 2 <= wanted) count *= 2;
+	return count;
+}
+
+void AnalysisCache::flush()
+{
+	if (!mapping) return;
+#ifdef _WIN32
+	FlushViewOfFile(mapping, 0);
+#else
+	msync(mapping, size_t(mapping_size), MS_ASYNC);
+#endif
+}
+
+bool AnalysisCache::probe(U64 key, Hit& hit) const
+{
+	if (!entries) return false;
+
+	const Entry* slot = bucket(key);
+	for (int i = 0; i < bucket_size; i++)
+	{
+		Entry entry = slot[i];
+		if (!entry.data || (entry.check ^ entry.data) != key) continue;
+
+		hit.move.initial_square = (unsigned char)(entry.data & 0xFF);
+		hit.move.final_square = (unsigned char)((entry.data >> 8) & 0xFF);
+		hit.score = short((entry.data >> 16) & 0xFFFF);
+		hit.depth = int((entry.data >> 32) & 0xFF);
+		hit.bound = int((entry.data >> 40) & 3);
+		return true;
+	}
+	return false;
+}
+
+void AnalysisCache::store(U64 key, ChessGame::Move move, int score, int depth, int bound)
+{
+	if (!entries) return;
+
+	Entry* slot = bucket(key);
+	Entry* victim = nullptr;
+	int victim_depth = 256;
+
+	for (int i = 0; i < bucket_size; i++)
+	{
+		Entry entry = slot[i];
+		bool valid = entry.data && ((entry.data >> 40) & 3);
+		int entry_depth = valid ? int((entry.data >> 32) & 0xFF) : -1;
+
+		if (valid && (entry.check ^ entry.data) == key)
+		{
+			// a shallower result only replaces the same position's entry if it is exact
+			if (depth < entry_depth && bound != EXACT) return;
+			victim = &slot[i];
+			break;
+		}
+		// otherwise the shallowest entry (an empty or torn one first) is given up
+		if (entry_depth < victim_depth)
+		{
+			victim = &slot[i];
+			victim_depth = entry_depth;
+		}
+	}
+
+	if (depth > 255) depth = 255;
+	U64 data = U64(move.initial_square) | (U64(move.final_square) << 8) | (U64((unsigned short)(short)score) << 16) | (U64(depth) << 32) | (U64(bound & 3) << 40);
+
+	victim->data = data;
+	victim->check = key ^ data;
+}
+
+#ifdef _WIN32
+
+bool AnalysisCache::map(const std::string& path, U64 size, int mode)
+{
+	DWORD disposition = mode == MAP_NEW ? CREATE_NEW : mode == MAP_REPLACE ? CREATE_ALWAYS : OPEN_EXISTING;
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+
+	if (mode == MAP_EXISTING)
+	{
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(handle, &file_size))
+		{
+			CloseHandle(handle);
+			return false;
+		}
+		size = U64(file_size.QuadPart);
+	}
+
+	// an empty file cannot be mapped; it is kept open with no view so the caller can tell it apart
+	if (!size)
+	{
+		file = handle;
+		return true;
+	}
+
+	// a mapping larger than the file grows it, zero-filled
+	HANDLE view_handle = CreateFileMappingA(handle, nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size & 0xFFFFFFFF), nullptr);
+	void* view = view_handle ? MapViewOfFile(view_handle, FILE_MAP_ALL_ACCESS, 0, 0, 0) : nullptr;
+	if (!view)
+	{
+		if (view_handle) CloseHandle(view_handle);
+		CloseHandle(handle);
+		return false;
+	}
+
+	file = handle;
+	file_mapping = view_handle;
+	mapping = static_cast<unsigned char*>(view);
+	mapping_size = size;
+	return true;
+}
+
+void AnalysisCache::unmap()
+{
+	if (mapping) UnmapViewOfFile(mapping);
+	if (file_mapping) CloseHandle(file_mapping);
+	if (file) CloseHandle(file);
+	file = nullptr;
+	file_mapping = nullptr;
+	mapping = nullptr;
+	mapping_size = 0ULL;
+	entries = nullptr;
+	entry_count = 0ULL;
+}
+
+#else
+
+bool AnalysisCache::map(const std::string& path, U64 size, int mode)
+{
+	int flags = mode == MAP_NEW ? O_RDWR | O_CREAT | O_EXCL : mode == MAP_REPLACE ? O_RDWR | O_TRUNC : O_RDWR;
+	int handle = ::open(path.c_str(), flags, 0644);
+	if (handle < 0) return false;
+
+	struct stat info;
+	bool sized = mode != MAP_EXISTING ? ftruncate(handle, off_t(size)) == 0 : fstat(handle, &info) == 0;
+	if (mode == MAP_EXISTING && sized) size = U64(info.st_size);
+
+	// an empty file cannot be mapped; it is kept open with no view so the caller can tell it apart
+	if (sized && !size)
+	{
+		file = handle;
+		return true;
+	}
+
+	void* view = sized ? mmap(nullptr, size_t(size), PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0) : MAP_FAILED;
+	if (view == MAP_FAILED)
+	{
+		::close(handle);
+		return false;
+	}
+
+	file = handle;
+	mapping = static_cast<unsigned char*>(view);
+	mapping_size = size;
+	return true;
+}
+
+void AnalysisCache::unmap()
+{
+	if (mapping) munmap(mapping, size_t(mapping_size));
+	if (file >= 0) ::close(file);
+	file = -1;
+	mapping = nullptr;
+	mapping_size = 0ULL;
+	entries = nullptr;
+	entry_count = 0ULL;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#pragma once
+#include "ChessGame.h"
+#include <string>
+#include <vector>
+
+// Persistent analysis cache: a hash table of position key -> best move, score, depth and
+// bound, kept in a memory-mapped file so that a restarted process sees earlier results
+// without a load pass.
+//
+// The file is a small header followed by buckets of four 16-byte entries. The header is
+// written with its ready marker last. A cache file cut short while being created, or written
+// by another format version, is rebuilt on open, as is an empty file; any other file is
+// refused and left as it is. Each entry stores key ^ data next to the
+// data; an entry torn by a crash or by two threads writing at once fails that check and
+// reads as empty. Dirty pages belong to the operating system, so a crashed process loses
+// nothing it has already stored.
+//
+// allocate() builds a table of the same layout in memory only; the search uses one as its
+// transposition table when it is not given a cache file.
+class AnalysisCache
+{
+public:
+	const enum enumBound
+	{
+		NO_BOUND,
+		UPPER_BOUND,	// score <= value
+		LOWER_BOUND,	// score >= value
+		EXACT
+	};
+
+	const enum enumOpenResult
+	{
+		OPENED,
+		CANNOT_MAP,
+		NOT_A_CACHE		// the file exists and holds something else
+	};
+
+	struct Hit
+	{
+		ChessGame::Move move{};
+		int score = 0;
+		int depth = 0;
+		int bound = NO_BOUND;
+	};
+
+	const static unsigned int file_version = 1;
+
+	AnalysisCache() {}
+	~AnalysisCache();
+	AnalysisCache(const AnalysisCache&) = delete;
+	AnalysisCache& operator=(const AnalysisCache&) = delete;
+
+	// Maps the file, creating it with size_mb megabytes if it is missing, empty or a stale
+	// cache; an existing valid file keeps its own size.
+	enumOpenResult open(const std::string& path, int size_mb);
+	// an in-memory table of size_mb megabytes, rounded down to a power of two entries
+	void allocate(int size_mb);
+	void close();
+	// empties the table; a file-backed one loses its stored analysis too
+	void clear();
+	// asks the operating system to write the mapped pages back now
+	void flush();
+
+	bool probe(U64 key, Hit& hit) const;
+	void store(U64 key, ChessGame::Move move, int score, int depth, int bound);
+
+	inline bool is_open() const { return entries != nullptr; }
+	inline U64 size() const { return entry_count; }
+
+private:
+	struct Header
+	{
+		char magic[4];
+		unsigned int version;
+		unsigned int entry_size;
+		unsigned int ready;			// written last; anything else means an unfinished file
+		U64 entry_count;
+		U64 reserved[5];
+	};
+
+	// data: from 0-7, to 8-15, score 16-31, depth 32-39, bound 40-41; check = key ^ data
+	struct Entry
+	{
+		U64 check;
+		U64 data;
+	};
+
+	const enum enumMapMode
+	{
+		MAP_EXISTING,	// the file as it is
+		MAP_NEW,		// a file that must not exist yet
+		MAP_REPLACE		// an existing file, emptied and resized
+	};
+
+	const static unsigned int ready_marker = 0x59444552;	// "REDY"
+	const static int bucket_size = 4;
+
+	unsigned char* mapping = nullptr;
+	U64 mapping_size = 0ULL;
+	Entry* entries = nullptr;
+	U64 entry_count = 0ULL;
+	std::vector<Entry> memory;		// the table when it is not backed by a file
+#ifdef _WIN32
+	void* file = nullptr;
+	void* file_mapping = nullptr;
+#else
+	int file = -1;
+#endif
+
+	bool map(const std::string& path, U64 size, int mode);
+	void unmap();
+	static U64 entries_for(int size_mb);
+	inline Entry* bucket(U64 key) const { return &entries[(key & (entry_count - 1)) & ~U64(bucket_size - 1)]; }
+};
@@ -0,0 +1,254 @@
+#include "Bitbase.h"
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+
+const char* const Bitbase::file_names[endgame_count] { "kpk.bitbase", "krk.bitbase", "kqk.bitbase" };
+
+std::vector<unsigned char> Bitbase::tables[endgame_count];
+
+void Bitbase::init(const std::string& directory, int threads)
+{
+	for (int endgame = KPK; endgame < endgame_count; endgame++)
+	{
+		std::string path = directory + "/" + file_names[endgame];
+
+		if (load(enumEndgame(endgame), path)) continue;
+
+		std::cout << "generating " << file_names[endgame] << "...\n";
+		generate(enumEndgame(endgame), threads);
+		save(enumEndgame(endgame), path);
+	}
+}
+
+U64 Bitbase::piece_attacks(enumEndgame endgame, int piece_square, U64 occupied)
+{
+	U64 piece = 1ULL << piece_square;
+
+	switch (endgame)
+	{
+	case KPK:
+		return ChessGame::pawn_attack_set<ChessGame::white>(piece);
+	case KRK:
+		return ChessGame::sliding_attacks(piece, 0ULL, ~occupied);
+	case KQK:
+		return ChessGame::sliding_attacks(piece, piece, ~occupied);
+	default:
+		return 0ULL;
+	}
+}
+
+// One step of the fixed-point iteration: decides index from the states of its successors,
+// or returns UNKNOWN if they are not settled yet.
+unsigned char Bitbase::classify(enumEndgame endgame, int index, const unsigned char* states)
+{
+	bool weak_to_move = index & 1;
+	int weak_king = (index >> 1) & 63;
+	int strong_king = (index >> 7) & 63;
+	int piece_square = endgame == KPK ? pawn_square(index >> 13) : (index >> 13);
+
+	U64 weak_king_bb = 1ULL << weak_king;
+	U64 strong_king_bb = 1ULL << strong_king;
+	U64 piece_bb = 1ULL << piece_square;
+
+	if (weak_king == strong_king || weak_king == piece_square || strong_king == piece_square) return INVALID;
+	if (ChessGame::king_mask(strong_king) & weak_king_bb) return INVALID;
+
+	U64 occupied = weak_king_bb | strong_king_bb | piece_bb;
+
+	if (!weak_to_move)
+	{
+		if (piece_attacks(endgame, piece_square, occupied) & weak_king_bb) return INVALID;
+
+		// a pawn on the seventh that promotes without being taken wins
+		if (endgame == KPK && (piece_square >> 3) == 6)
+		{
+			int promotion_square = piece_square + 8;
+			U64 promotion_bb = 1ULL << promotion_square;
+			if (!(promotion_bb & occupied) && (!(ChessGame::king_mask(weak_king) & promotion_bb) || (ChessGame::king_mask(strong_king) & promotion_bb))) return WIN;
+		}
+
+		bool all_draw = true;
+		bool any_move = false;
+
+		U64 king_targets = ChessGame::king_mask(strong_king) & ~ChessGame::king_mask(weak_king) & ~occupied;
+		for (; king_targets; king_targets &= king_targets - 1)
+		{
+			unsigned char child = states[encode(endgame, piece_square, ChessGame::bit_scan_forward(king_targets), weak_king, true)];
+			if (child == WIN) return WIN;
+			all_draw &= child == DRAW;
+			any_move = true;
+		}
+
+		U64 piece_targets = 0ULL;
+		if (endgame == KPK)
+		{
+			if ((piece_square >> 3) < 6 && !((piece_bb << 8) & occupied))
+			{
+				piece_targets |= piece_bb << 8;
+				if ((piece_square >> 3) == 1 && !((piece_bb << 16) & occupied)) piece_targets |= piece_bb << 16;
+			}
+		}
+		else
+		{
+			piece_targets = piece_attacks(endgame, piece_square, occupied) & ~occupied;
+		}
+
+		for (; piece_targets; piece_targets &= piece_targets - 1)
+		{
+			unsigned char child = states[encode(endgame, ChessGame::bit_scan_forward(piece_targets), strong_king, weak_king, true)];
+			if (child == WIN) return WIN;
+			all_draw &= child == DRAW;
+			any_move = true;
+		}
+
+		return (all_draw || !any_move) ? DRAW : UNKNOWN;
+	}
+
+	U64 attacked = ChessGame::king_mask(strong_king) | piece_attacks(endgame, piece_square, occupied & ~weak_king_bb);
+	U64 king_targets = ChessGame::king_mask(weak_king) & ~attacked;
+
+	if (!king_targets) return (attacked & weak_king_bb) ? WIN : DRAW;
+
+	// the lone piece is taken
+	if (king_targets & piece_bb) return DRAW;
+
+	bool all_win = true;
+	for (; king_targets; king_targets &= king_targets - 1)
+	{
+		unsigned char child = states[encode(endgame, piece_square, strong_king, ChessGame::bit_scan_forward(king_targets), false)];
+		if (child == DRAW) return DRAW;
+		all_win &= child == WIN;
+	}
+
+	return all_win ? WIN : UNKNOWN;
+}
+
+void Bitbase::generate(enumEndgame endgame, int threads)
+{
+	int size = table_size(endgame);
+
+	if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+	// double-buffered so every worker reads a stable previous iteration
+	std::vector<unsigned char> states(size, UNKNOWN);
+	std::vector<unsigned char> next(size, UNKNOWN);
+	std::vector<int> changes(threads);
+
+	int changed;
+	do
+	{
+		std::vector<std::thread> workers;
+		int chunk = (size + threads - 1) / threads;
+
+		for (int t = 0; t < threads; t++)
+		{
+			workers.emplace_back([&, t]()
+			{
+				int begin = t * chunk;
+				int end = std::min(size, begin + chunk);
+				changes[t] = 0;
+				for (int index = begin; index < end; index++)
+				{
+					next[index] = states[index] == UNKNOWN ? classify(endgame, index, states.data()) : states[index];
+					changes[t] += next[index] != states[index];
+				}
+			});
+		}
+
+		for (std::thread& worker : workers) worker.join();
+
+		states.swap(next);
+
+		changed = 0;
+		for (int c : changes) changed += c;
+	} while (changed);
+
+	// anything still undecided can never be forced
+	std::vector<unsigned char>& table = tables[endgame];
+	table.assign(size / 8, 0);
+	for (int index = 0; index < size; index++)
+	{
+		if (states[index] == WIN) table[index >> 3] |= 1 << (index & 7);
+	}
+}
+
+bool Bitbase::load(enumEndgame endgame, const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return false;
+
+	char magic[4];
+	unsigned int header[3];
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+
+	if (!file || std::string(magic, 4) != "BBCB" || header[0] != file_version || header[1] != unsigned(endgame) || header[2] != unsigned(table_size(endgame))) return false;
+
+	std::vector<unsigned char> table(table_size(endgame) / 8);
+	file.read(reinterpret_cast<char*>(table.data()), table.size());
+	if (!file) return false;
+
+	tables[endgame].swap(table);
+	return true;
+}
+
+bool Bitbase::save(enumEndgame endgame, const std::string& path)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file || !is_loaded(endgame)) return false;
+
+	unsigned int header[3]{ file_version, unsigned(endgame), unsigned(table_size(endgame)) };
+	file.write("BBCB", 4);
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(tables[endgame].data()), tables[endgame].size());
+
+	return bool(file);
+}
+
+ChessGame::enumBitbaseResult Bitbase::probe(const ChessGame::Position& position)
+{
+	U64 occupied = ~position.empty_squares();
+
+	// exactly three men on the board
+	U64 rest = occupied & (occupied - 1);
+	rest &= rest - 1;
+	if (!rest || (rest & (rest - 1))) return ChessGame::BB_UNKNOWN;
+
+	U64 extra = occupied & ~position.pieces(ChessGame::nKing);
+	enumEndgame endgame;
+
+	if (extra & position.pieces(ChessGame::nPawn)) endgame = KPK;
+	else if (extra & position.pieces(ChessGame::nRook)) endgame = KRK;
+	else if (extra & position.pieces(ChessGame::nQueen)) endgame = KQK;
+	else return ChessGame::BB_UNKNOWN;
+
+	if (!is_loaded(endgame)) return ChessGame::BB_UNKNOWN;
+
+	bool strong_is_black = extra & position.pieces(ChessGame::nBlack);
+	int flip = strong_is_black ? 56 : 0;
+
+	int piece_square = ChessGame::bit_scan_forward(extra) ^ flip;
+	int strong_king = ChessGame::bit_scan_forward(position.pieces(ChessGame::nKing) & position.pieces(strong_is_black)) ^ flip;
+	int weak_king = ChessGame::bit_scan_forward(position.pieces(ChessGame::nKing) & position.pieces(!strong_is_black)) ^ flip;
+	bool weak_to_move = position.color_to_move != strong_is_black;
+
+	if (endgame == KPK)
+	{
+		int rank = piece_square >> 3;
+		if (rank == 0 || rank == 7) return ChessGame::BB_UNKNOWN;
+		if ((piece_square & 7) > 3)
+		{
+			piece_square ^= 7;
+			strong_king ^= 7;
+			weak_king ^= 7;
+		}
+	}
+
+	int index = encode(endgame, piece_square, strong_king, weak_king, weak_to_move);
+
+	if (!(tables[endgame][index >> 3] & (1 << (index & 7)))) return ChessGame::BB_DRAW;
+
+	return weak_to_move ? ChessGame::BB_LOSS : ChessGame::BB_WIN;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "ChessGame.h"
+#include <string>
+#include <vector>
+
+// Win/draw bitbases for KPK, KRK and KQK.
+//
+// Every endgame is stored as one bit per position (1 = the side with the extra
+// piece wins), always seen from that side as white. Black-strong positions are
+// mirrored vertically before probing, and KPK is further mirrored so the pawn
+// sits on files a-d.
+//
+// index = (((piece_index * 64) + strong_king) * 64 + weak_king) * 2 + weak_to_move
+class Bitbase
+{
+public:
+	const enum enumEndgame
+	{
+		KPK,
+		KRK,
+		KQK,
+		endgame_count
+	};
+
+	const static int kpk_size = 24 * 64 * 64 * 2;
+	const static int kxk_size = 64 * 64 * 64 * 2;
+
+	const static unsigned int file_version = 1;
+
+	// Loads the bitbase files from directory, generating (and writing) any that are missing or stale.
+	static void init(const std::string& directory = ".", int threads = 0);
+	static void generate(enumEndgame endgame, int threads = 0);
+	static bool load(enumEndgame endgame, const std::string& path);
+	static bool save(enumEndgame endgame, const std::string& path);
+	static bool is_loaded(enumEndgame endgame) { return !tables[endgame].empty(); }
+
+	static ChessGame::enumBitbaseResult probe(const ChessGame::Position& position);
+
+private:
+	const enum enumState : unsigned char
+	{
+		UNKNOWN,
+		INVALID,
+		DRAW,
+		WIN
+	};
+
+	const static char* const file_names[endgame_count];
+
+	static std::vector<unsigned char> tables[endgame_count];
+
+	inline static int table_size(enumEndgame endgame) { return endgame == KPK ? kpk_size : kxk_size; }
+	inline static int pawn_index(int square) { return ((square >> 3) - 1) * 4 + (square & 7); }
+	inline static int pawn_square(int index) { return ((index >> 2) + 1) * 8 + (index & 3); }
+	inline static int encode(enumEndgame endgame, int piece_square, int strong_king, int weak_king, bool weak_to_move)
+	{
+		int piece = endgame == KPK ? pawn_index(piece_square) : piece_square;
+		return (((piece * 64) + strong_king) * 64 + weak_king) * 2 + weak_to_move;
+	}
+
+	static U64 piece_attacks(enumEndgame endgame, int piece_square, U64 occupied);
+	static unsigned char classify(enumEndgame endgame, int index, const unsigned char* states);
+};
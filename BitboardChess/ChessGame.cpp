@@ -1,12 +1,27 @@
 ﻿#include "ChessGame.h"
+#include "Bitbase.h"
+#include "Profiler.h"
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <Windows.h>
 #include <stdlib.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(CHESS_QUAD_BITBOARDS) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#endif
 
 const ChessGame::Position ChessGame::starting_position
 {
+#ifdef CHESS_QUAD_BITBOARDS
+	{
+		0xFFFF000000000000,	// black
+		0x8100000000000081 | 0x2400000000000024 | 0x1000000000000010,	// type bit 0: rooks, bishops, kings
+		0x00FF00000000FF00 | 0x8100000000000081 | 0x0800000000000008 | 0x1000000000000010,	// type bit 1: pawns, rooks, queens, kings
+		0x4200000000000042 | 0x2400000000000024 | 0x0800000000000008 | 0x1000000000000010,	// type bit 2: knights, bishops, queens, kings
+	},
+#else
 	{
 		0x000000000000FFFF, // white pieces
 		0xFFFF000000000000, // black pieces
@@ -18,7 +33,14 @@ const ChessGame::Position ChessGame::starting_position
 		0x1000000000000010, // kings
 	},
 	0x0000FFFFFFFF0000,	// empty squares
+#endif
 	ChessGame::white,
+	ChessGame::NORMAL,
+	0ULL,
+	{ 0x0000000000FFFF7E, 0x7EFFFF0000000000 },	// attacked squares
+	{ 0x000000000000DF56, 0x56DF000000000000 },	// attacked by sliders
+	0,	// halfmove clock
+	ChessGame::pawn_key(0x000000000000FF00, 0x00FF000000000000),	// pawn key
 };
 
 // De Bruijn sequence to 64-index mapping
@@ -43,62 +65,372 @@ const int ChessGame::bishop_direction[4]{ 9, -7, -9, 7 };
 
 U64 ChessGame::mask_pawn_attacks(Position position, bool is_black)
 {
-	U64 pawns = position.piece_bitboards[nPawn] & position.piece_bitboards[is_black];
+	return is_black ? mask_pawn_attacks_t<black>(position) : mask_pawn_attacks_t<white>(position);
+}
 
-	U64 attacks = is_black ? bitboard_union((pawns >> 7) & ~a_file, (pawns >> 9) & ~h_file) : bitboard_union((pawns << 7) & ~h_file, (pawns << 9) & ~a_file);
+U64 ChessGame::mask_single_pushable_pawns(Position position, bool is_black)
+{
+	return is_black ? mask_single_pushable_pawns_t<black>(position) : mask_single_pushable_pawns_t<white>(position);
+}
 
-	return attacks;
+U64 ChessGame::mask_double_pushable_pawns(Position position, bool is_black)
+{
+	return is_black ? mask_double_pushable_pawns_t<black>(position) : mask_double_pushable_pawns_t<white>(position);
 }
 
-U64 ChessGame::mask_single_pushable_pawns(Position position, bool is_black)
+U64 ChessGame::mask_single_pawn_push(Position position, bool is_black)
 {
-	U64 pawns = position.piece_bitboards[ChessGame::nPawn] & position.piece_bitboards[is_black];
+	return is_black ? mask_single_pawn_push_t<black>(position) : mask_single_pawn_push_t<white>(position);
+}
 
-	U64 pushable = _rotr64(position.empty, 8 - (is_black << 4)) & pawns;
+U64 ChessGame::mask_double_pawn_push(Position position, bool is_black)
+{
+	return is_black ? mask_double_pawn_push_t<black>(position) : mask_double_pawn_push_t<white>(position);
+}
 
-	return pushable;
+template<ChessGame::enumColor Us>
+U64 ChessGame::mask_pawn_attacks_t(const Position& position)
+{
+	return pawn_attack_set<Us>(position.pieces(nPawn) & position.pieces(Us));
 }
 
-U64 ChessGame::mask_double_pushable_pawns(Position position, bool is_black)
+template<ChessGame::enumColor Us>
+U64 ChessGame::mask_single_pushable_pawns_t(const Position& position)
 {
-	U64 pushable_rank[2]{ forth_rank, fifth_rank };
+	constexpr enumColor Them = Us == white ? black : white;
 
-	U64 pawns = position.piece_bitboards[ChessGame::nPawn] & position.piece_bitboards[is_black];
+	return pawn_push<Them>(position.empty_squares()) & position.pieces(nPawn) & position.pieces(Us);
+}
+
+template<ChessGame::enumColor Us>
+U64 ChessGame::mask_double_pushable_pawns_t(const Position& position)
+{
+	constexpr enumColor Them = Us == white ? black : white;
 
-	U64 pushable = _rotr64(pushable_rank[is_black], 16 - (is_black << 5)) & starting_position.piece_bitboards[nPawn] & mask_single_pushable_pawns(position, is_black);
+	U64 start_rank = pawn_push<Them>(relative_third_rank<Us>());
+	U64 both_empty = pawn_push<Them>(position.empty_squares()) & pawn_push<Them>(pawn_push<Them>(position.empty_squares()));
 
-	return pushable;
+	return both_empty & start_rank & position.pieces(nPawn) & position.pieces(Us);
 }
 
-U64 ChessGame::mask_single_pawn_push(Position position, bool is_black)
+template<ChessGame::enumColor Us>
+U64 ChessGame::mask_single_pawn_push_t(const Position& position)
 {
-	U64 pawns = position.piece_bitboards[ChessGame::nPawn] & position.piece_bitboards[is_black];
+	return pawn_push<Us>(position.pieces(nPawn) & position.pieces(Us)) & position.empty_squares();
+}
 
-	U64 pushed = _rotl64(pawns, 8 - (is_black << 4)) & position.empty;
-	return pushed;
+template<ChessGame::enumColor Us>
+U64 ChessGame::mask_double_pawn_push_t(const Position& position)
+{
+	return pawn_push<Us>(pawn_push<Us>(position.pieces(nPawn) & position.pieces(Us))) & position.empty_squares();
 }
 
-U64 ChessGame::mask_double_pawn_push(Position position, bool is_black)
+template<ChessGame::enumColor Us>
+U64 ChessGame::pawn_moves_mask_t(int square, const Position& position)
+{
+	U64 pawn = 1ULL << square;
+	U64 single = pawn_push<Us>(pawn) & position.empty_squares();
+	U64 pushes = single | (pawn_push<Us>(single & relative_third_rank<Us>()) & position.empty_squares());
+
+	return pushes | (pawn_attack_set<Us>(pawn) & ~position.empty_squares());
+}
+
+// enemy pieces attacking square
+template<ChessGame::enumColor Us>
+U64 ChessGame::attackers_t(int square, const Position& position)
+{
+	constexpr enumColor Them = Us == white ? black : white;
+
+	U64 bb = 1ULL << square;
+	U64 enemy = position.pieces(Them);
+	U64 queens = position.pieces(nQueen);
+
+	return enemy & ((pawn_attack_set<Us>(bb) & position.pieces(nPawn))
+		| (knight_attack_set(bb) & position.pieces(nKnight))
+		| (sliding_attacks(bb, 0ULL, position.empty_squares()) & (position.pieces(nRook) | queens))
+		| (sliding_attacks(0ULL, bb, position.empty_squares()) & (position.pieces(nBishop) | queens))
+		| (king_mask(square) & position.pieces(nKing)));
+}
+
+// squares a non-king piece on square may move to without leaving its king in check
+template<ChessGame::enumColor Us>
+U64 ChessGame::legal_mask_t(int square, const Position& position)
+{
+	constexpr enumColor Them = Us == white ? black : white;
+
+	U64 piece_bb = 1ULL << square;
+	U64 king = position.pieces(nKing) & position.pieces(Us);
+	int king_square = bit_scan_forward(king);
+	U64 allowed = ~0ULL;
+
+	if (king & position.attack_maps[Them])
+	{
+		U64 checkers = attackers_t<Us>(king_square, position);
+		if (checkers & (checkers - 1)) return 0ULL;
+		allowed = checkers | between_mask(king_square, bit_scan_forward(checkers));
+	}
+
+	if (!(queen_mask_ex(king_square) & piece_bb)) return allowed;
+
+	// with the piece lifted, any enemy slider the king now sees through its square pins it
+	U64 enemy = position.pieces(Them);
+	U64 queens = position.pieces(nQueen);
+	U64 snipers = (sliding_attacks(king, 0ULL, position.empty_squares() | piece_bb) & (position.pieces(nRook) | queens) & rook_mask_ex(king_square))
+		| (sliding_attacks(0ULL, king, position.empty_squares() | piece_bb) & (position.pieces(nBishop) | queens) & bishop_mask_ex(king_square));
+
+	for (snipers &= enemy; snipers; snipers &= snipers - 1)
+	{
+		int sniper = bit_scan_forward(snipers);
+		U64 ray = between_mask(king_square, sniper);
+		if (ray & piece_bb) return allowed & (ray | (1ULL << sniper));
+	}
+
+	return allowed;
+}
+
+template<ChessGame::enumColor Us>
+U64 ChessGame::moves_t(int square, const Position& position, unsigned char flags)
+{
+	constexpr enumColor Them = Us == white ? black : white;
+
+	U64 piece_bb = (1ULL << square);
+	U64 move_mask = (bool(flags & EMPTY) * position.empty_squares()) | (bool(flags & CAPTURE) * position.pieces(Them)) | (bool(flags & DEFEND) * position.pieces(Us));
+
+	if (piece_bb & position.pieces(nKing) & position.pieces(Us)) return king_moves(position, Us) & move_mask;
+
+	U64 moves = 0ULL;
+	U64 queens = position.pieces(nQueen);
+
+	if (piece_bb & position.pieces(nPawn)) moves = pawn_moves_mask_t<Us>(square, position);
+	else if (piece_bb & position.pieces(nKnight)) moves = knight_attack_set(piece_bb);
+	else moves = sliding_attacks(piece_bb & (position.pieces(nRook) | queens), piece_bb & (position.pieces(nBishop) | queens), position.empty_squares());
+
+	return moves & move_mask & legal_mask_t<Us>(square, position);
+}
+
+// pinned pieces and the rays they are pinned along; snipers are found with only enemy pieces as blockers
+template<ChessGame::enumColor Us>
+U64 ChessGame::pins_t(const Position& position, int king_square, U64 pin_pieces[8], U64 pin_rays[8], int& pin_count)
+{
+	constexpr enumColor Them = Us == white ? black : white;
+
+	U64 enemy = position.pieces(Them);
+	U64 king = 1ULL << king_square;
+	U64 queens = position.pieces(nQueen);
+	U64 snipers = ((sliding_attacks(king, 0ULL, ~enemy) & (position.pieces(nRook) | queens))
+		| (sliding_attacks(0ULL, king, ~enemy) & (position.pieces(nBishop) | queens))) & enemy;
+
+	U64 pinned = 0ULL;
+	pin_count = 0;
+
+	for (; snipers; snipers &= snipers - 1)
+	{
+		int sniper = bit_scan_forward(snipers);
+		U64 ray = between_mask(king_square, sniper);
+		U64 blockers = ray & ~position.empty_squares();
+		if (blockers && !(blockers & (blockers - 1)) && (blockers & position.pieces(Us)))
+		{
+			pinned |= blockers;
+			pin_pieces[pin_count] = blockers;
+			pin_rays[pin_count++] = ray | (1ULL << sniper);
+		}
+	}
+
+	return pinned;
+}
+
+template<ChessGame::enumColor Us>
+void ChessGame::generate_moves_t(const Position& position, MoveList& list)
+{
+	constexpr enumColor Them = Us == white ? black : white;
+	constexpr int up = Us == white ? 8 : -8;
+	constexpr int up_west = Us == white ? 7 : -9;
+	constexpr int up_east = Us == white ? 9 : -7;
+
+	U64 own = position.pieces(Us);
+	U64 enemy = position.pieces(Them);
+	U64 king = position.pieces(nKing) & own;
+	int king_square = bit_scan_forward(king);
+
+	for (U64 targets = king_moves(position, Us); targets; targets &= targets - 1)
+	{
+		list.add(king_square, bit_scan_forward(targets));
+	}
+
+	U64 check_mask = ~0ULL;
+	if (king & position.attack_maps[Them])
+	{
+		U64 checkers = attackers_t<Us>(king_square, position);
+		if (checkers & (checkers - 1)) return;
+		check_mask = checkers | between_mask(king_square, bit_scan_forward(checkers));
+	}
+
+	U64 queens = position.pieces(nQueen);
+	U64 pin_rays[8];
+	U64 pin_pieces[8];
+	int pin_count = 0;
+	U64 pinned = pins_t<Us>(position, king_square, pin_pieces, pin_rays, pin_count);
+
+	auto pin_ray = [&](U64 piece_bb)
+	{
+		for (int i = 0; i < pin_count; i++)
+		{
+			if (pin_pieces[i] & piece_bb) return pin_rays[i];
+		}
+		return ~0ULL;
+	};
+
+	// unpinned pawns, set-wise
+	U64 pawns = position.pieces(nPawn) & own & ~pinned;
+	U64 single = pawn_push<Us>(pawns) & position.empty_squares();
+	U64 double_push = pawn_push<Us>(single & relative_third_rank<Us>()) & position.empty_squares() & check_mask;
+	U64 west = (Us == white ? (pawns << 7) & ~h_file : (pawns >> 9) & ~h_file) & enemy & check_mask;
+	U64 east = (Us == white ? (pawns << 9) & ~a_file : (pawns >> 7) & ~a_file) & enemy & check_mask;
+	single &= check_mask;
+
+	for (; single; single &= single - 1) { int to = bit_scan_forward(single); list.add(to - up, to); }
+	for (; double_push; double_push &= double_push - 1) { int to = bit_scan_forward(double_push); list.add(to - 2 * up, to); }
+	for (; west; west &= west - 1) { int to = bit_scan_forward(west); list.add(to - up_west, to); }
+	for (; east; east &= east - 1) { int to = bit_scan_forward(east); list.add(to - up_east, to); }
+
+	for (U64 pinned_pawns = position.pieces(nPawn) & own & pinned; pinned_pawns; pinned_pawns &= pinned_pawns - 1)
+	{
+		int from = bit_scan_forward(pinned_pawns);
+		U64 targets = pawn_moves_mask_t<Us>(from, position) & ~own & check_mask & pin_ray(1ULL << from);
+		for (; targets; targets &= targets - 1) list.add(from, bit_scan_forward(targets));
+	}
+
+	// a pinned knight can never move
+	for (U64 knights = position.pieces(nKnight) & own & ~pinned; knights; knights &= knights - 1)
+	{
+		int from = bit_scan_forward(knights);
+		U64 targets = knight_attack_set(1ULL << from) & ~own & check_mask;
+		for (; targets; targets &= targets - 1) list.add(from, bit_scan_forward(targets));
+	}
+
+	U64 straight = position.pieces(nRook) | queens;
+	U64 diagonal = position.pieces(nBishop) | queens;
+
+	for (U64 sliders = (straight | diagonal) & own; sliders; sliders &= sliders - 1)
+	{
+		int from = bit_scan_forward(sliders);
+		U64 piece_bb = 1ULL << from;
+		U64 targets = sliding_attacks(piece_bb & straight, piece_bb & diagonal, position.empty_squares()) & ~own & check_mask;
+		if (piece_bb & pinned) targets &= pin_ray(piece_bb);
+		for (; targets; targets &= targets - 1) list.add(from, bit_scan_forward(targets));
+	}
+}
+
+// generate_moves_t without the list: returns at the first legal move, trying the king (already
+// known from the attack maps), then unpinned pawns, knights and sliders set-wise, and the pinned pieces last
+template<ChessGame::enumColor Us>
+bool ChessGame::has_legal_move_t(const Position& position)
+{
+	constexpr enumColor Them = Us == white ? black : white;
+
+	if (king_moves(position, Us)) return true;
+
+	U64 own = position.pieces(Us);
+	U64 enemy = position.pieces(Them);
+	U64 king = position.pieces(nKing) & own;
+	int king_square = bit_scan_forward(king);
+
+	U64 check_mask = ~0ULL;
+	if (king & position.attack_maps[Them])
+	{
+		U64 checkers = attackers_t<Us>(king_square, position);
+		if (checkers & (checkers - 1)) return false;
+		check_mask = checkers | between_mask(king_square, bit_scan_forward(checkers));
+	}
+
+	U64 pin_rays[8];
+	U64 pin_pieces[8];
+	int pin_count = 0;
+	U64 pinned = pins_t<Us>(position, king_square, pin_pieces, pin_rays, pin_count);
+
+	U64 pawns = position.pieces(nPawn) & own & ~pinned;
+	U64 single = pawn_push<Us>(pawns) & position.empty_squares();
+	U64 double_push = pawn_push<Us>(single & relative_third_rank<Us>()) & position.empty_squares();
+	if ((single | double_push | (pawn_attack_set<Us>(pawns) & enemy)) & check_mask) return true;
+
+	if (knight_attack_set(position.pieces(nKnight) & own & ~pinned) & ~own & check_mask) return true;
+
+	U64 queens = position.pieces(nQueen);
+	U64 straight = (position.pieces(nRook) | queens) & own;
+	U64 diagonal = (position.pieces(nBishop) | queens) & own;
+	if (sliding_attacks(straight & ~pinned, diagonal & ~pinned, position.empty_squares()) & ~own & check_mask) return true;
+
+	// a pinned knight can never move
+	for (int i = 0; i < pin_count; i++)
+	{
+		U64 piece_bb = pin_pieces[i];
+		U64 targets = 0ULL;
+
+		if (piece_bb & position.pieces(nPawn)) targets = pawn_moves_mask_t<Us>(bit_scan_forward(piece_bb), position);
+		else if (!(piece_bb & position.pieces(nKnight))) targets = sliding_attacks(piece_bb & straight, piece_bb & diagonal, position.empty_squares());
+
+		if (targets & ~own & check_mask & pin_rays[i]) return true;
+	}
+
+	return false;
+}
+
+template void ChessGame::generate_moves_t<ChessGame::white>(const Position& position, MoveList& list);
+template void ChessGame::generate_moves_t<ChessGame::black>(const Position& position, MoveList& list);
+template U64 ChessGame::moves_t<ChessGame::white>(int square, const Position& position, unsigned char flags);
+template U64 ChessGame::moves_t<ChessGame::black>(int square, const Position& position, unsigned char flags);
+
+void ChessGame::generate_moves(const Position& position, MoveList& list)
+{
+	list.count = 0;
+	position.color_to_move == black ? generate_moves_t<black>(position, list) : generate_moves_t<white>(position, list);
+}
+
+bool ChessGame::has_legal_move(const Position& position)
+{
+	return position.color_to_move == black ? has_legal_move_t<black>(position) : has_legal_move_t<white>(position);
+}
+
+ChessGame::enumGameState ChessGame::game_state(const Position& position)
 {
-	U64 pawns = position.piece_bitboards[ChessGame::nPawn] & position.piece_bitboards[is_black];
+	bool is_black = position.color_to_move;
+	bool check = position.pieces(nKing) & position.pieces(is_black) & position.attack_maps[!is_black];
 
-	U64 pushed = _rotl64(pawns, 16 - (is_black << 5)) & position.empty;
-	return pushed;
+	if (has_legal_move(position)) return check ? CHECK : NORMAL;
+	return check ? CHECKMATE : STALEMATE;
+}
+
+U64 ChessGame::perft(const Position& position, int depth)
+{
+	MoveList list;
+	generate_moves(position, list);
+
+	if (depth <= 1) return depth == 1 ? list.count : 1;
+
+	U64 nodes = 0;
+	for (int i = 0; i < list.count; i++)
+	{
+		Position next = position;
+		make_move(next, list.moves[i].initial_square, list.moves[i].final_square);
+		nodes += perft(next, depth - 1);
+	}
+	return nodes;
 }
 
 ChessGame::ChessGame(Position position)
 {
 	current_position = position;
-	position_history_3fold[pos_stringid(position)] = 1;
+	update_attack_maps(current_position);
+	position_history[history_count++] = position_key(current_position);
 }
 
-ChessGame::ChessGame(std::string fen) : ChessGame(fen_to_pos(fen))
+ChessGame::ChessGame(const std::string& fen) : ChessGame(fen_to_pos(fen))
 {
 }
 
 U64 ChessGame::pawn_moves_mask(int square, Position position, bool is_black)
 {
-	return (mask_double_pushable_pawns(position, is_black) & (1ULL << square) ? pawn_double_push_mask(square, position, is_black) : pawn_single_push_mask(square, position, is_black)) & position.empty | (pawn_attack_mask(square, position, is_black) & ~position.empty);
+	return is_black ? pawn_moves_mask_t<black>(square, position) : pawn_moves_mask_t<white>(square, position);
 }
 
 U64 ChessGame::rook_moves_mask(int square, Position position, bool is_black)
@@ -107,7 +439,7 @@ U64 ChessGame::rook_moves_mask(int square, Position position, bool is_black)
 	for (int d : rook_direction)
 	{
 		U64 ray, line = 0ULL;
-		for (ray = 1ULL << square; (ray = ((d > 0) ? (ray << d) : (ray >> -d))) && !(ray & ~rook_mask_ex(square)) && !((line |= ray) & ~position.empty););
+		for (ray = 1ULL << square; (ray = ((d > 0) ? (ray << d) : (ray >> -d))) && !(ray & ~rook_mask_ex(square)) && !((line |= ray) & ~position.empty_squares()););
 		rook_moves |= line;
 	}
 	return rook_moves;
@@ -119,7 +451,7 @@ U64 ChessGame::bishop_moves_mask(int square, Position position, bool is_black)
 	for (int d : bishop_direction)
 	{
 		U64 ray, line = 0ULL;
-		for (ray = 1ULL << square; (ray = ((d > 0) ? (ray << d) : (ray >> -d))) && !(ray & ~bishop_mask_ex(square)) && !((line |= ray) & ~position.empty););
+		for (ray = 1ULL << square; (ray = ((d > 0) ? (ray << d) : (ray >> -d))) && !(ray & ~bishop_mask_ex(square)) && !((line |= ray) & ~position.empty_squares()););
 		bishop_moves |= line;
 	}
 	return bishop_moves;
@@ -127,9 +459,7 @@ U64 ChessGame::bishop_moves_mask(int square, Position position, bool is_black)
 
 U64 ChessGame::knight_moves_mask(int square, Position position, bool is_black)
 {
-	U64 knight = (1ULL << square);
-	return ((knight << 6 | knight << 15 | knight >> 10 | knight >> 17) & ~gh_file) |
-		((knight << 10 | knight << 17 | knight >> 6 | knight >> 15) & ~ab_file);
+	return knight_attack_set(1ULL << square);
 }
 
 U64 ChessGame::queen_moves_mask(int square, Position position, bool is_black)
@@ -139,7 +469,7 @@ U64 ChessGame::queen_moves_mask(int square, Position position, bool is_black)
 
 U64 ChessGame::rook_moves(Position position, bool is_black)
 {
-	U64 rooks = position.piece_bitboards[nRook] & position.piece_bitboards[is_black];
+	U64 rooks = position.pieces(nRook) & position.pieces(is_black);
 	U64 rook_moves = 0ULL;
 	for (int square = 0; (square = bit_scan_forward(rooks)) != -1; rooks &= rooks - 1)
 	{
@@ -150,7 +480,7 @@ U64 ChessGame::rook_moves(Position position, bool is_black)
 
 U64 ChessGame::bishop_moves(Position position, bool is_black)
 {
-	U64 bishops = position.piece_bitboards[nBishop] & position.piece_bitboards[is_black];
+	U64 bishops = position.pieces(nBishop) & position.pieces(is_black);
 	U64 bishop_moves = 0ULL;
 	for (int square = 0; (square = bit_scan_forward(bishops)) != -1; bishops &= bishops - 1)
 	{
@@ -161,18 +491,16 @@ U64 ChessGame::bishop_moves(Position position, bool is_black)
 
 U64 ChessGame::knight_moves(Position position, bool is_black)
 {
-	U64 knights = position.piece_bitboards[nKnight] & position.piece_bitboards[is_black];
+	U64 knights = position.pieces(nKnight) & position.pieces(is_black);
 
-	U64 moves = (((knights << 6 | knights << 15 | knights >> 10 | knights >> 17) & ~gh_file) |
-		((knights << 10 | knights << 17 | knights >> 6 | knights >> 15) & ~ab_file)) &
-		(position.empty | position.piece_bitboards[!is_black]);
+	U64 moves = knight_attack_set(knights) & (position.empty_squares() | position.pieces(!is_black));
 
 	return moves;
 }
 
 U64 ChessGame::queen_moves(Position position, bool is_black)
 {
-	U64 queens = position.piece_bitboards[nQueen] & position.piece_bitboards[is_black];
+	U64 queens = position.pieces(nQueen) & position.pieces(is_black);
 	U64 queen_moves = 0ULL;
 	for (int square = 0; (square = bit_scan_forward(queens)) != -1; queens &= queens - 1)
 	{
@@ -183,17 +511,22 @@ U64 ChessGame::queen_moves(Position position, bool is_black)
 
 U64 ChessGame::king_moves(Position position, bool is_black)
 {
-	U64 king = position.piece_bitboards[nKing] & position.piece_bitboards[is_black];
-	Position trans_pos = position;
-	trans_pos.piece_bitboards[nKing] &= ~king;
-	trans_pos.piece_bitboards[is_black] &= ~king;
-	trans_pos.empty |= king;
-	return (north_one(king) | north_east_one(king) | east_one(king) | south_east_one(king) | south_one(king) | south_west_one(king) | west_one(king) | north_west_one(king)) & (position.empty | position.piece_bitboards[!is_black]) & ~attacks(trans_pos, !is_black);
+	PROFILE_SCOPE(KING_MOVES);
+
+	U64 king = position.pieces(nKing) & position.pieces(is_black);
+	U64 attacked = position.attack_maps[!is_black];
+
+	// a king checked by a slider may not step back along the checking ray
+	if (king & position.slider_attack_maps[!is_black]) attacked |= slider_attacks(position, !is_black, position.empty_squares() | king);
+
+	return (north_one(king) | north_east_one(king) | east_one(king) | south_east_one(king) | south_one(king) | south_west_one(king) | west_one(king) | north_west_one(king)) & (position.empty_squares() | position.pieces(!is_black)) & ~attacked;
 }
 
 U64 ChessGame::all_legal_moves(Position position, bool is_black)
 {
-	U64 color_bb = position.piece_bitboards[is_black];
+	PROFILE_SCOPE(ALL_LEGAL_MOVES);
+
+	U64 color_bb = position.pieces(is_black);
 	U64 moves_bb = 0ULL;
 
 	while (color_bb)
@@ -207,117 +540,223 @@ U64 ChessGame::all_legal_moves(Position position, bool is_black)
 
 U64 ChessGame::moves(int square, Position position, bool is_black, unsigned char flags)
 {
-	U64 piece_bb = (1ULL << square);
-	U64 move_mask = (bool(flags & EMPTY) * position.empty) | (bool(flags & CAPTURE) * position.piece_bitboards[!is_black]) | (bool(flags & DEFEND) * position.piece_bitboards[is_black]);
+	PROFILE_SCOPE(MOVES);
 
-	if (piece_bb & position.piece_bitboards[nKing] & position.piece_bitboards[is_black]) return king_moves(position, is_black) & move_mask;
+	return is_black ? moves_t<black>(square, position, flags) : moves_t<white>(square, position, flags);
+}
 
-	int type;
-	U64 moves = 0ULL;
-	U64 bitboard = 0ULL;
-	
-	int king_square = bit_scan_forward(position.piece_bitboards[nKing] & position.piece_bitboards[is_black]);
+U64 ChessGame::rook_attacks(Position position, bool is_black)
+{
+	return rook_moves(position, is_black) & position.pieces(!is_black);
+}
 
-	//U64 king_check_mask = queen_moves_mask(king_square, position, is_black);
+U64 ChessGame::bishop_attacks(Position position, bool is_black)
+{
+	return bishop_moves(position, is_black) & position.pieces(!is_black);
+}
 
-	//U64 rook_check;
-	//U64 bishop_check;
-	//U64 knight_check;
+U64 ChessGame::knight_attacks(Position position, bool is_black)
+{
+	return knight_moves(position, is_black) & position.pieces(!is_black);
+}
 
-	//U64 checks = (rook_check = king_check_mask & rook_mask(king_square) & position.piece_bitboards[!is_black] & (position.piece_bitboards[nRook] | position.piece_bitboards[nQueen]))
-	//| (bishop_check = king_check_mask & bishop_mask(king_square) & position.piece_bitboards[!is_black] & (position.piece_bitboards[nBishop] | position.piece_bitboards[nQueen]))
-	//| (knight_check = knight_moves_mask(king_square, position, is_black) & position.piece_bitboards[!is_black] & position.piece_bitboards[nKnight]);
+U64 ChessGame::queen_attacks(Position position, bool is_black)
+{
+	return queen_moves(position, is_black) & position.pieces(!is_black);
+}
 
-	//if (checks & (checks - 1)) return 0x0;
+U64 ChessGame::king_attacks(Position position, bool is_black)
+{
+	return king_moves(position, is_black) & position.pieces(!is_black);
+}
 
-	for (type = nPawn; !(bitboard = position.piece_bitboards[type] & piece_bb) && (type < nKing); type++);
+U64 ChessGame::attacks(Position position, bool is_black)
+{
+	PROFILE_SCOPE(ATTACKS);
 
-	switch (type)
-	{
-	case nPawn: 
-		moves = pawn_moves_mask(square, position, is_black);
-		break;
-	case nRook:
-		moves = rook_moves_mask(square, position, is_black);
-		break;
-	case nKnight: 
-		moves = knight_moves_mask(square, position, is_black);
-		break;
-	case nBishop:
-		moves = bishop_moves_mask(square, position, is_black);
-		break;
-	case nQueen: 
-		moves = queen_moves_mask(square, position, is_black);
-		break;
-	default:
-		break;
-	}
+	U64 side = position.pieces(is_black);
+	U64 queens = position.pieces(nQueen) & side;
 
-	moves &= move_mask;
+	return mask_pawn_attacks(position, is_black)
+		| knight_attack_set(position.pieces(nKnight) & side)
+		| sliding_attacks((position.pieces(nRook) & side) | queens, (position.pieces(nBishop) & side) | queens, position.empty_squares())
+		| king_mask(bit_scan_forward(position.pieces(nKing) & side));
+}
+
+U64 ChessGame::slider_attacks(const Position& position, bool is_black, U64 empty)
+{
+	U64 side = position.pieces(is_black);
+	U64 queens = position.pieces(nQueen) & side;
 
-	if (position.state == CHECK) moves &= position.checking_path_bb;
+	return sliding_attacks((position.pieces(nRook) & side) | queens, (position.pieces(nBishop) & side) | queens, empty);
+}
 
-	//print_bitboard(king_check_mask);
-	//print_bitboard(king_check_mask & rook_mask(king_square));
-	//print_bitboard(king_check_mask & rook_mask(king_square) & rook_moves_mask(bit_scan_forward(bishop_check), position, !is_black));
+U64 ChessGame::leaper_attacks(const Position& position, bool is_black)
+{
+	return mask_pawn_attacks(position, is_black)
+		| knight_attack_set(position.pieces(nKnight) & position.pieces(is_black))
+		| king_mask(bit_scan_forward(position.pieces(nKing) & position.pieces(is_black)));
+}
 
-	//if (knight_check) moves &= knight_check;
-	//if (bishop_check) moves &= king_check_mask & bishop_mask(king_square) & bishop_moves_mask(bit_scan_forward(bishop_check), position, !is_black) | bishop_check;
-	//if (rook_check) moves &= king_check_mask & rook_mask(king_square) & rook_moves_mask(bit_scan_forward(rook_check), position, !is_black) | rook_check;
+void ChessGame::update_attack_maps(Position& position)
+{
+	for (int side = white; side <= black; side++)
+	{
+		position.slider_attack_maps[side] = slider_attacks(position, side, position.empty_squares());
+		position.attack_maps[side] = leaper_attacks(position, side) | position.slider_attack_maps[side];
+	}
+}
 
-	U64 king_pin_mask = pin_mask(position, is_black);
+U64 ChessGame::between_mask(int square1, int square2)
+{
+	U64 bb1 = 1ULL << square1;
+	U64 bb2 = 1ULL << square2;
+	U64 line;
 
-	if (!(king_pin_mask & piece_bb)) return moves;
+	if (rank_mask(square1) & bb2) line = rank_mask(square1);
+	else if (file_mask(square1) & bb2) line = file_mask(square1);
+	else if (diagonal_mask(square1) & bb2) line = diagonal_mask(square1);
+	else if (anti_diag_mask(square1) & bb2) line = anti_diag_mask(square1);
+	else return 0ULL;
 
-	Position trans_position = position;
+	return line & sliding_attacks(bb1, bb1, ~bb2) & sliding_attacks(bb2, bb2, ~bb1);
+}
 
-	trans_position.piece_bitboards[is_black] &= ~piece_bb;
-	trans_position.piece_bitboards[type] &= ~piece_bb;
-	trans_position.empty |= piece_bb;
+U64 ChessGame::sliding_attacks_scalar(U64 rooks, U64 bishops, U64 empty)
+{
+	const int shift[4]{ 8, 9, 1, 7 };
+	const U64 wrap[4]{ ~0ULL, ~a_file, ~a_file, ~h_file };
+	const U64 wrap_back[4]{ ~0ULL, ~h_file, ~h_file, ~a_file };
 
-	U64 rook_mask_moves = rook_moves_mask(king_square, trans_position, is_black);
-	if (rook_mask_moves & (position.piece_bitboards[!is_black] & (trans_position.piece_bitboards[nQueen] | trans_position.piece_bitboards[nRook]))) return moves & rook_mask_ex(square) & rook_mask_ex(king_square);
+	U64 attacks = 0ULL;
 
-	U64 bishop_mask_moves = bishop_moves_mask(king_square, trans_position, is_black);
-	if (bishop_mask_moves & (position.piece_bitboards[!is_black] & (trans_position.piece_bitboards[nQueen] | trans_position.piece_bitboards[nBishop]))) return moves & bishop_mask_ex(square) & bishop_mask_ex(king_square);
+	for (int d = 0; d < 4; d++)
+	{
+		U64 gen = (d & 1) ? bishops : rooks;
+		U64 pro = empty & wrap[d];
+		int s = shift[d];
+
+		gen |= pro & (gen << s);
+		pro &= pro << s;
+		gen |= pro & (gen << 2 * s);
+		pro &= pro << 2 * s;
+		gen |= pro & (gen << 4 * s);
+		attacks |= (gen << s) & wrap[d];
+
+		gen = (d & 1) ? bishops : rooks;
+		pro = empty & wrap_back[d];
+
+		gen |= pro & (gen >> s);
+		pro &= pro >> s;
+		gen |= pro & (gen >> 2 * s);
+		pro &= pro >> 2 * s;
+		gen |= pro & (gen >> 4 * s);
+		attacks |= (gen >> s) & wrap_back[d];
+	}
 
-	return moves;
+	return attacks;
 }
 
-U64 ChessGame::rook_attacks(Position position, bool is_black)
+#ifdef CHESS_QUAD_BITBOARDS
+// Every type set is (quad[1] ^ m1) & (quad[2] ^ m2) & (quad[3] ^ m3), where a mask is all ones
+// when the type's code bit is clear, so one set per 64-bit lane falls out of three xors and two ands.
+void ChessGame::Position::bitboards(U64 out[8]) const
 {
-	return rook_moves(position, is_black) & position.piece_bitboards[!is_black];
-}
+#if defined(__AVX2__)
+	const __m256i q1 = _mm256_set1_epi64x((long long)quad[1]);
+	const __m256i q2 = _mm256_set1_epi64x((long long)quad[2]);
+	const __m256i q3 = _mm256_set1_epi64x((long long)quad[3]);
+	const __m256i ones = _mm256_set1_epi64x(-1LL);
+	const __m256i zero = _mm256_setzero_si256();
+
+	// lanes hold types 0-3 then 4-7; _mm256_set_epi64x lists the highest lane first
+	__m256i low = _mm256_and_si256(_mm256_and_si256(
+		_mm256_xor_si256(q1, _mm256_set_epi64x(0, -1LL, 0, -1LL)),
+		_mm256_xor_si256(q2, _mm256_set_epi64x(0, 0, -1LL, -1LL))),
+		_mm256_xor_si256(q3, ones));
+	__m256i high = _mm256_and_si256(_mm256_and_si256(
+		_mm256_xor_si256(q1, _mm256_set_epi64x(0, -1LL, 0, -1LL)),
+		_mm256_xor_si256(q2, _mm256_set_epi64x(0, 0, -1LL, -1LL))),
+		_mm256_xor_si256(q3, zero));
+
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), low);
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 4), high);
+#elif defined(__SSE2__) || defined(_M_X64)
+	const __m128i q1 = _mm_set1_epi64x((long long)quad[1]);
+	const __m128i q2 = _mm_set1_epi64x((long long)quad[2]);
+	const __m128i q3 = _mm_set1_epi64x((long long)quad[3]);
+	const __m128i odd = _mm_set_epi64x(0, -1LL);		// lane 0 even type, lane 1 odd type
+	const __m128i ones = _mm_set1_epi64x(-1LL);
+
+	for (int pair = 0; pair < 4; pair++)
+	{
+		__m128i m2 = (pair & 1) ? _mm_setzero_si128() : ones;
+		__m128i m3 = (pair & 2) ? _mm_setzero_si128() : ones;
+		__m128i sets = _mm_and_si128(_mm_and_si128(_mm_xor_si128(q1, odd), _mm_xor_si128(q2, m2)), _mm_xor_si128(q3, m3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * pair), sets);
+	}
+#else
+	for (int type = 0; type < 8; type++)
+	{
+		out[type] = (quad[1] ^ (U64(type & 1) - 1)) & (quad[2] ^ (U64((type >> 1) & 1) - 1)) & (quad[3] ^ (U64((type >> 2) & 1) - 1));
+	}
+#endif
 
-U64 ChessGame::bishop_attacks(Position position, bool is_black)
-{
-	return bishop_moves(position, is_black) & position.piece_bitboards[!is_black];
+	// codes 0 and 1 are not pieces; those two slots hold the colours
+	out[nWhite] = occupied() & ~quad[0];
+	out[nBlack] = quad[0];
 }
-
-U64 ChessGame::knight_attacks(Position position, bool is_black)
+#else
+void ChessGame::Position::bitboards(U64 out[8]) const
 {
-	return knight_moves(position, is_black) & position.piece_bitboards[!is_black];
+	for (int type = 0; type < 8; type++) out[type] = piece_bitboards[type];
 }
+#endif
 
-U64 ChessGame::queen_attacks(Position position, bool is_black)
+#ifdef __AVX2__
+U64 ChessGame::sliding_attacks(U64 rooks, U64 bishops, U64 empty)
 {
-	return queen_moves(position, is_black) & position.piece_bitboards[!is_black];
+	PROFILE_SCOPE(SLIDING_ATTACKS);
+
+	// lanes: north, north east, east, north west (left shifts) and the mirrored right shifts
+	const __m256i shift = _mm256_setr_epi64x(8, 9, 1, 7);
+	const __m256i shift2 = _mm256_slli_epi64(shift, 1);
+	const __m256i shift4 = _mm256_slli_epi64(shift, 2);
+	const __m256i wrap = _mm256_setr_epi64x(~0ULL, ~a_file, ~a_file, ~h_file);
+	const __m256i wrap_back = _mm256_setr_epi64x(~0ULL, ~h_file, ~h_file, ~a_file);
+
+	__m256i sliders = _mm256_setr_epi64x(rooks, bishops, rooks, bishops);
+	__m256i empty_v = _mm256_set1_epi64x(empty);
+
+	__m256i gen = sliders;
+	__m256i pro = _mm256_and_si256(empty_v, wrap);
+	gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_sllv_epi64(gen, shift)));
+	pro = _mm256_and_si256(pro, _mm256_sllv_epi64(pro, shift));
+	gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_sllv_epi64(gen, shift2)));
+	pro = _mm256_and_si256(pro, _mm256_sllv_epi64(pro, shift2));
+	gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_sllv_epi64(gen, shift4)));
+	__m256i attacks = _mm256_and_si256(_mm256_sllv_epi64(gen, shift), wrap);
+
+	gen = sliders;
+	pro = _mm256_and_si256(empty_v, wrap_back);
+	gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_srlv_epi64(gen, shift)));
+	pro = _mm256_and_si256(pro, _mm256_srlv_epi64(pro, shift));
+	gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_srlv_epi64(gen, shift2)));
+	pro = _mm256_and_si256(pro, _mm256_srlv_epi64(pro, shift2));
+	gen = _mm256_or_si256(gen, _mm256_and_si256(pro, _mm256_srlv_epi64(gen, shift4)));
+	attacks = _mm256_or_si256(attacks, _mm256_and_si256(_mm256_srlv_epi64(gen, shift), wrap_back));
+
+	__m128i folded = _mm_or_si128(_mm256_castsi256_si128(attacks), _mm256_extracti128_si256(attacks, 1));
+	return U64(_mm_cvtsi128_si64(folded) | _mm_extract_epi64(folded, 1));
 }
-
-U64 ChessGame::king_attacks(Position position, bool is_black)
+#else
+U64 ChessGame::sliding_attacks(U64 rooks, U64 bishops, U64 empty)
 {
-	return king_moves(position, is_black) & position.piece_bitboards[!is_black];
-}
+	PROFILE_SCOPE(SLIDING_ATTACKS);
 
-U64 ChessGame::attacks(Position position, bool is_black)
-{
-	return mask_pawn_attacks(position, is_black)
-		| rook_moves(position, is_black)
-		| knight_moves(position, is_black)
-		| bishop_moves(position, is_black)
-		| queen_moves(position, is_black)
-		| king_mask(bit_scan_forward(position.piece_bitboards[nKing] & position.piece_bitboards[is_black]));
+	return sliding_attacks_scalar(rooks, bishops, empty);
 }
+#endif
 
 int ChessGame::pop_count(U64 bitboard) 
 {
@@ -382,8 +821,8 @@ void ChessGame::print_board(Position position, U64 moves)
 		{
 			U64 sq_bitboard = 1ULL << (rank * max_rank + file);
 			int piece_type;
-			bool is_white = sq_bitboard & position.piece_bitboards[nWhite];
-			bool is_empty_sq = sq_bitboard & position.empty;
+			bool is_white = sq_bitboard & position.pieces(nWhite);
+			bool is_empty_sq = sq_bitboard & position.empty_squares();
 
 			std::cout << ' ';
 
@@ -401,7 +840,7 @@ void ChessGame::print_board(Position position, U64 moves)
 				}
 			}
 
-			for (piece_type = nPawn; !(sq_bitboard & position.piece_bitboards[piece_type]); piece_type++);
+			for (piece_type = nPawn; !(sq_bitboard & position.pieces(piece_type)); piece_type++);
 
 			if (sq_bitboard & moves)
 			{
@@ -438,11 +877,13 @@ void ChessGame::print_board(Position position, U64 moves)
 
 void ChessGame::print_position(Position position)
 {
-	for (U64 bb : position.piece_bitboards)
+	U64 bitboards[8];
+	position.bitboards(bitboards);
+	for (U64 bb : bitboards)
 	{
 		print_bitboard(bb);
 	}
-	print_bitboard(position.empty);
+	print_bitboard(position.empty_squares());
 	std::cout << position.color_to_move << std::endl;
 }
 
@@ -474,7 +915,7 @@ void ChessGame::start()
 			U64 square_moves = 0x0;
 			bool valid_square = (input.length() == 2) && islower(input[0]) && isdigit(input[1]) && ((initial_square = max_file * (input[1] - '1') + (input[0] - 'a')) >= 0) && (initial_square <= 63);
 			
-			if (valid_square && ((1ULL << initial_square) & current_position.piece_bitboards[current_position.color_to_move]) && (square_moves = moves(initial_square, current_position, current_position.color_to_move)))
+			if (valid_square && ((1ULL << initial_square) & current_position.pieces(current_position.color_to_move)) && (square_moves = moves(initial_square, current_position, current_position.color_to_move)))
 			{
 				system("cls");
 				
@@ -491,7 +932,8 @@ void ChessGame::start()
 					make_move(initial_square, final_square);
 					update_game_status();
 					
-					std::cout << "size: " << position_history_3fold.size() << std::endl;
+					std::cout << "size: " << history_count << std::endl;
+					if (bitbase_result != BB_UNKNOWN) std::cout << "bitbase: " << (bitbase_result == BB_DRAW ? "draw" : (bitbase_result == BB_WIN) != bool(current_position.color_to_move) ? "white wins" : "black wins") << std::endl;
 					getline(std::cin, input);
 					
 					game_over = current_position.state == CHECKMATE || current_position.state == REPETITION || current_position.state == STALEMATE;
@@ -508,7 +950,7 @@ void ChessGame::start()
 			{
 				//std::cout << valid_square << std::endl;
 
-				//print_bitboard((1ULL << initial_square) & current_position.piece_bitboards[current_position.color_to_move]);
+				//print_bitboard((1ULL << initial_square) & current_position.pieces(current_position.color_to_move));
 				//print_bitboard(square_moves);
 
 				//getline(std::cin, input);
@@ -537,7 +979,7 @@ void ChessGame::start()
 	}
 }
 
-void ChessGame::message(std::string message)
+void ChessGame::message(const std::string& message)
 {
 	std::string input;
 	system("cls");
@@ -547,119 +989,135 @@ void ChessGame::message(std::string message)
 
 void ChessGame::make_move(int initial_square, int final_square)
 {
+	make_move(current_position, initial_square, final_square);
+
+	// no earlier position can come back after a capture or pawn move
+	if (!current_position.halfmove_clock) history_count = 0;
+}
+
+void ChessGame::make_move(Position& position, int initial_square, int final_square, DirtyPieces* dirty)
+{
+	PROFILE_SCOPE(MAKE_MOVE);
+
 	U64 initial_square_bb = (1ULL << initial_square);
 	U64 final_square_bb = (1ULL << final_square);
+	U64 sliders_before = position.pieces(nRook) | position.pieces(nBishop) | position.pieces(nQueen);
 
-	enumColor color_to_move = current_position.color_to_move;
+	enumColor color_to_move = position.color_to_move;
 	int source_type;
 	int dest_type;
 
-	if (final_square_bb & ~current_position.empty)
+	position.halfmove_clock++;
+	if (dirty) dirty->count = 0;
+
+	if (final_square_bb & ~position.empty_squares())
 	{
-		for (dest_type = nPawn; (dest_type <= nKing) && !(current_position.piece_bitboards[dest_type] & final_square_bb); dest_type++);
-		current_position.piece_bitboards[!color_to_move] &= ~final_square_bb;
-		current_position.piece_bitboards[dest_type] &= ~final_square_bb;
-		position_history_3fold.clear();
+		dest_type = position.type_on(final_square);
+		position.remove_piece(dest_type, !color_to_move, final_square);
+		position.halfmove_clock = 0;
+		if (dest_type == nPawn) position.pawn_key ^= pawn_zobrist(!color_to_move, final_square);
+		if (dirty) dirty->add(dest_type, !color_to_move, final_square, no_square);
 	}
 
-	for (source_type = nPawn; (source_type <= nKing) && !(current_position.piece_bitboards[source_type] & initial_square_bb); source_type++);
+	source_type = position.type_on(initial_square);
+
+	if (source_type == nPawn)
+	{
+		position.halfmove_clock = 0;
+		position.pawn_key ^= pawn_zobrist(color_to_move, initial_square);
+		if (!(final_square_bb & (first_rank | eighth_rank))) position.pawn_key ^= pawn_zobrist(color_to_move, final_square);
+	}
 	
-	current_position.piece_bitboards[color_to_move] = current_position.piece_bitboards[color_to_move] & ~initial_square_bb | final_square_bb;
-	current_position.piece_bitboards[source_type] = current_position.piece_bitboards[source_type] & ~initial_square_bb | final_square_bb;
+	// pawns reaching the last rank promote to a queen
+	if (source_type == nPawn && (final_square_bb & (first_rank | eighth_rank)))
+	{
+		position.remove_piece(nPawn, color_to_move, initial_square);
+		position.add_piece(nQueen, color_to_move, final_square);
+		if (dirty)
+		{
+			dirty->add(nPawn, color_to_move, initial_square, no_square);
+			dirty->add(nQueen, color_to_move, no_square, final_square);
+		}
+	}
+	else
+	{
+		position.move_piece(source_type, color_to_move, initial_square, final_square);
+		if (dirty) dirty->add(source_type, color_to_move, initial_square, final_square);
+	}
+
+	position.color_to_move = enumColor(!color_to_move);
+
+	// only refill the sliders of a side whose rays crossed the from- or to-square, or that moved or lost a slider
+	U64 touched = initial_square_bb | final_square_bb;
+	U64 sliders_after = position.pieces(nRook) | position.pieces(nBishop) | position.pieces(nQueen);
 
-	current_position.empty = ~(current_position.piece_bitboards[nWhite] | current_position.piece_bitboards[nBlack]);
-	current_position.color_to_move = enumColor(!color_to_move);
+	for (int side = white; side <= black; side++)
+	{
+		if ((position.slider_attack_maps[side] | sliders_before | sliders_after) & touched)
+		{
+			position.slider_attack_maps[side] = slider_attacks(position, side, position.empty_squares());
+		}
+		position.attack_maps[side] = leaper_attacks(position, side) | position.slider_attack_maps[side];
+	}
 
-	//print_position(current_position);
+	//print_position(position);
 }
 
 void ChessGame::update_game_status()
 {
-	std::cout << pos_stringid(current_position) << std::endl;
-	if ((position_history_3fold[pos_stringid(current_position)] += 1) > 2)
+	PROFILE_SCOPE(UPDATE_GAME_STATUS);
+
+	bitbase_result = Bitbase::probe(current_position);
+
+	U64 key = position_key(current_position);
+	int repetitions = 1;
+	for (int i = history_count > history_size ? history_count - history_size : 0; i < history_count; i++)
+	{
+		if (position_history[i % history_size] == key) repetitions++;
+	}
+	position_history[history_count++ % history_size] = key;
+
+	if (repetitions > 2)
 	{
 		current_position.state = REPETITION;
 		return;
 	}
 
 	bool is_black = current_position.color_to_move;
-	int king_square = bit_scan_forward(current_position.piece_bitboards[nKing] & current_position.piece_bitboards[is_black]);
-	U64 king_check_mask = queen_moves_mask(king_square, current_position, is_black);
-
-	U64 rook_check;
-	U64 bishop_check;
-	U64 knight_check;
+	U64 king = current_position.pieces(nKing) & current_position.pieces(is_black);
+	int king_square = bit_scan_forward(king);
 
-	U64 checks = (rook_check = king_check_mask & rook_mask(king_square) & current_position.piece_bitboards[!is_black] & (current_position.piece_bitboards[nRook] | current_position.piece_bitboards[nQueen]))
-		| (bishop_check = king_check_mask & bishop_mask(king_square) & current_position.piece_bitboards[!is_black] & (current_position.piece_bitboards[nBishop] | current_position.piece_bitboards[nQueen]))
-		| (knight_check = knight_moves_mask(king_square, current_position, is_black) & current_position.piece_bitboards[!is_black] & current_position.piece_bitboards[nKnight]);
+	current_position.checking_path_bb = 0ULL;
 
-	bool king_can_move = king_moves(current_position, is_black);
-
-	if (checks)
+	if (king & current_position.attack_maps[!is_black])
 	{
-		bool double_check = checks & (checks - 1);
-		if (king_can_move)
-		{
-			current_position.state = CHECK;
-		}
-		else
-		{
-			if (double_check)
-			{
-				current_position.state = CHECKMATE;
-			}
-			else
-			{
-				U64 pin_path = 0ULL;
-				U64 moves_bb = 0ULL;
-
-				if (knight_check) pin_path = knight_check;
-				if (bishop_check) pin_path = king_check_mask & bishop_mask(king_square) & bishop_moves_mask(bit_scan_forward(bishop_check), current_position, !is_black) | bishop_check;
-				if (rook_check) pin_path = king_check_mask & rook_mask(king_square) & rook_moves_mask(bit_scan_forward(rook_check), current_position, !is_black) | rook_check;
+		U64 checks = is_black ? attackers_t<black>(king_square, current_position) : attackers_t<white>(king_square, current_position);
 
-				for (int type = nPawn; type <= nQueen; type++)
-				{
-					U64 type_bb = current_position.piece_bitboards[type] & current_position.piece_bitboards[is_black];
-					while (type_bb)
-					{
-						int square = bit_scan_forward(type_bb);
-						moves_bb |= moves(square, current_position, is_black) & pin_path;
-						type_bb &= type_bb - 1;
-					}
-				}
-
-				current_position.state = moves_bb ? CHECK : CHECKMATE;
-				current_position.checking_path_bb = pin_path;
-			}
+		// in double check only the king may move, so the path stays empty
+		if (!(checks & (checks - 1)))
+		{
+			current_position.checking_path_bb = checks | between_mask(king_square, bit_scan_forward(checks));
 		}
 	}
-	else if (!king_can_move)
-	{
-		U64 bb = 0ULL;
-
-		for (int type = nPawn; type <= nQueen; type++)
-		{
-			U64 type_bb = current_position.piece_bitboards[type] & current_position.piece_bitboards[is_black];
-			while (type_bb)
-			{
-				int square = bit_scan_forward(type_bb);
 
-				bb |= moves(square, current_position, is_black);
+	current_position.state = game_state(current_position);
+}
 
-				type_bb &= type_bb - 1;
-			}
-		}
+U64 ChessGame::position_key(const Position& position)
+{
+	U64 sets[8];
+	position.bitboards(sets);
 
-		current_position.state = bb ? NORMAL : STALEMATE;
-	}
-	else
+	U64 key = position.color_to_move == black ? 0x9E3779B97F4A7C15ULL : 0ULL;
+	for (int i = nWhite; i <= nKing; i++)
 	{
-		current_position.state = NORMAL;
+		key = (key ^ sets[i]) * 0xBF58476D1CE4E5B9ULL;
+		key ^= key >> 31;
 	}
+	return key;
 }
 
-ChessGame::Position ChessGame::fen_to_pos(std::string fen)
+ChessGame::Position ChessGame::fen_to_pos(const std::string& fen)
 {
 	ChessGame::Position position = {};
 
@@ -685,52 +1143,40 @@ ChessGame::Position ChessGame::fen_to_pos(std::string fen)
 			switch (c)
 			{
 			case 'P':
-				set_bit(position.piece_bitboards[ChessGame::nPawn], square);
-				set_bit(position.piece_bitboards[ChessGame::nWhite], square);
+				position.add_piece(ChessGame::nPawn, ChessGame::white, square);
 				break;
 			case 'R':
-				set_bit(position.piece_bitboards[ChessGame::nRook], square);
-				set_bit(position.piece_bitboards[ChessGame::nWhite], square);
+				position.add_piece(ChessGame::nRook, ChessGame::white, square);
 				break;
 			case 'N':
-				set_bit(position.piece_bitboards[ChessGame::nKnight], square);
-				set_bit(position.piece_bitboards[ChessGame::nWhite], square);
+				position.add_piece(ChessGame::nKnight, ChessGame::white, square);
 				break;
 			case 'B':
-				set_bit(position.piece_bitboards[ChessGame::nBishop], square);
-				set_bit(position.piece_bitboards[ChessGame::nWhite], square);
+				position.add_piece(ChessGame::nBishop, ChessGame::white, square);
 				break;
 			case 'Q':
-				set_bit(position.piece_bitboards[ChessGame::nQueen], square);
-				set_bit(position.piece_bitboards[ChessGame::nWhite], square);
+				position.add_piece(ChessGame::nQueen, ChessGame::white, square);
 				break;
 			case 'K':
-				set_bit(position.piece_bitboards[ChessGame::nKing], square);
-				set_bit(position.piece_bitboards[ChessGame::nWhite], square);
+				position.add_piece(ChessGame::nKing, ChessGame::white, square);
 				break;
 			case 'p':
-				set_bit(position.piece_bitboards[ChessGame::nPawn], square);
-				set_bit(position.piece_bitboards[ChessGame::nBlack], square);
+				position.add_piece(ChessGame::nPawn, ChessGame::black, square);
 				break;
 			case 'r':
-				set_bit(position.piece_bitboards[ChessGame::nRook], square);
-				set_bit(position.piece_bitboards[ChessGame::nBlack], square);
+				position.add_piece(ChessGame::nRook, ChessGame::black, square);
 				break;
 			case 'n':
-				set_bit(position.piece_bitboards[ChessGame::nKnight], square);
-				set_bit(position.piece_bitboards[ChessGame::nBlack], square);
+				position.add_piece(ChessGame::nKnight, ChessGame::black, square);
 				break;
 			case 'b':
-				set_bit(position.piece_bitboards[ChessGame::nBishop], square);
-				set_bit(position.piece_bitboards[ChessGame::nBlack], square);
+				position.add_piece(ChessGame::nBishop, ChessGame::black, square);
 				break;
 			case 'q':
-				set_bit(position.piece_bitboards[ChessGame::nQueen], square);
-				set_bit(position.piece_bitboards[ChessGame::nBlack], square);
+				position.add_piece(ChessGame::nQueen, ChessGame::black, square);
 				break;
 			case 'k':
-				set_bit(position.piece_bitboards[ChessGame::nKing], square);
-				set_bit(position.piece_bitboards[ChessGame::nBlack], square);
+				position.add_piece(ChessGame::nKing, ChessGame::black, square);
 				break;
 			default:
 				break;
@@ -738,23 +1184,78 @@ ChessGame::Position ChessGame::fen_to_pos(std::string fen)
 			square--;
 		}
 	}
-	position.empty = ~(position.piece_bitboards[ChessGame::nWhite] | position.piece_bitboards[ChessGame::nBlack]);
+	position.pawn_key = pawn_key(position.pieces(nPawn) & position.pieces(nWhite), position.pieces(nPawn) & position.pieces(nBlack));
+	update_attack_maps(position);
 	
-	std::getline(ss_meta, token, ' ');
+	ss_meta >> token;
 
 	position.color_to_move = enumColor(token[0] == 'b');
 
+	// castling and en passant fields are not used by this engine
+	std::string castling, en_passant;
+	if (!(ss_meta >> castling >> en_passant >> position.halfmove_clock)) position.halfmove_clock = 0;
+
 	return position;
 }
 
-std::string ChessGame::pos_stringid(Position position)
+const char* ChessGame::fen_error(const std::string& fen)
+{
+	// fen_to_pos trusts the placement field, so its shape is checked before it is parsed
+	std::istringstream fields(fen);
+	std::string placement;
+	std::string side;
+	if (!(fields >> placement >> side)) return "missing fields";
+	if (side != "w" && side != "b") return "side to move";
+
+	int rank = 0;
+	int files = 0;
+	int kings[2]{};
+	for (char c : placement)
+	{
+		if (c == '/')
+		{
+			if (files != 8) return "rank length";
+			rank++;
+			files = 0;
+		}
+		else if (c >= '1' && c <= '8')
+		{
+			files += c - '0';
+		}
+		else if (std::string("PNBRQKpnbrqk").find(c) != std::string::npos)
+		{
+			// the first and last ranks of the text are the eighth and first ranks
+			if ((c == 'P' || c == 'p') && (rank == 0 || rank == 7)) return "pawn on a back rank";
+			if (c == 'K' || c == 'k') kings[c == 'k']++;
+			files++;
+		}
+		else
+		{
+			return "unknown piece";
+		}
+		if (files > 8) return "rank length";
+	}
+	if (rank != 7 || files != 8) return "rank count";
+
+	// attack maps are built from the kings, so they are counted before the position is
+	if (kings[0] != 1 || kings[1] != 1) return "one king per side";
+
+	// the side that just moved cannot have left its king attacked
+	Position position = fen_to_pos(fen);
+	int waiting = !position.color_to_move;
+	if (position.pieces(nKing) & position.pieces(waiting) & position.attack_maps[position.color_to_move]) return "side not to move is in check";
+
+	return nullptr;
+}
+
+std::string ChessGame::pos_stringid(const Position& position)
 {
 	std::string stringid = "";
 	for (int type = nPawn; type <= nKing; type++)
 	{
-		stringid += std::to_string(position.piece_bitboards[type]);
+		stringid += std::to_string(position.pieces(type));
 	}
-	stringid += std::to_string(position.color_to_move;
+	stringid += std::to_string(position.color_to_move);
 
 	return stringid;
 }
@@ -1,6 +1,5 @@
 #pragma once
 #include <string>
-#include <map>
 
 typedef unsigned long long U64;
 
@@ -53,13 +52,147 @@ public:
 		DEFEND	= 0x04
 	};
 
+	const enum enumBitbaseResult
+	{
+		BB_UNKNOWN,	// not a bitbase endgame
+		BB_DRAW,
+		BB_WIN,		// side to move wins
+		BB_LOSS		// side to move loses
+	};
+
+	// Board layout. By default one board per colour and per piece type, plus the empty squares.
+	// Built with CHESS_QUAD_BITBOARDS, four boards hold a 4-bit code per square instead:
+	// quad[0] is the colour (set = black) and quad[1..3] are the three bits of the enumPiece type,
+	// so an empty square is code 0. Read through pieces() / empty_squares() and write through
+	// add_piece() / remove_piece() / move_piece(), which both layouts provide.
 	struct Position
 	{
+#ifdef CHESS_QUAD_BITBOARDS
+		U64 quad[4];
+#else
 		U64 piece_bitboards[8];
-		U64 empty;
+		U64 empty = ~0ULL;
+#endif
 		enumColor color_to_move = white;
 		enumGameState state = NORMAL;
 		U64 checking_path_bb = 0ULL;
+		U64 attack_maps[2]{};			// squares attacked by each side, kept up to date by make_move
+		U64 slider_attack_maps[2]{};	// rook, bishop and queen share of attack_maps
+		int halfmove_clock = 0;			// plies since the last capture or pawn move
+		U64 pawn_key = 0ULL;			// Zobrist key of the pawns alone, kept up to date by make_move
+
+#ifdef CHESS_QUAD_BITBOARDS
+		inline U64 occupied() const { return quad[1] | quad[2] | quad[3]; }
+		inline U64 empty_squares() const { return ~occupied(); }
+
+		// a type's set is the squares whose three code bits match it; the colours come from quad[0]
+		inline U64 pieces(int type) const
+		{
+			if (type == nBlack) return quad[0];
+			if (type == nWhite) return occupied() & ~quad[0];
+			return (quad[1] ^ (U64(type & 1) - 1)) & (quad[2] ^ (U64((type >> 1) & 1) - 1)) & (quad[3] ^ (U64((type >> 2) & 1) - 1));
+		}
+
+		// enumPiece type on square (nWhite if empty), read straight from the code bits
+		inline int type_on(int square) const { return int(((quad[1] >> square) & 1) | (((quad[2] >> square) & 1) << 1) | (((quad[3] >> square) & 1) << 2)); }
+
+		inline void add_piece(int type, int color, int square)
+		{
+			U64 bb = 1ULL << square;
+			int code = (type << 1) | color;
+			for (int i = 0; i < 4; i++) quad[i] |= (0ULL - U64((code >> i) & 1)) & bb;
+		}
+
+		// the square's code bits are cleared whatever they hold, so type and colour are not needed
+		inline void remove_piece(int /*type*/, int /*color*/, int square)
+		{
+			U64 bb = ~(1ULL << square);
+			for (int i = 0; i < 4; i++) quad[i] &= bb;
+		}
+
+		inline void move_piece(int type, int color, int from, int to)
+		{
+			U64 from_to = (1ULL << from) | (1ULL << to);
+			U64 to_bb = 1ULL << to;
+			int code = (type << 1) | color;
+			for (int i = 0; i < 4; i++) quad[i] = (quad[i] & ~from_to) | ((0ULL - U64((code >> i) & 1)) & to_bb);
+		}
+#else
+		inline U64 occupied() const { return ~empty; }
+		inline U64 empty_squares() const { return empty; }
+		inline U64 pieces(int type) const { return piece_bitboards[type]; }
+
+		// enumPiece type on square (nWhite if empty)
+		inline int type_on(int square) const
+		{
+			U64 bb = 1ULL << square;
+			if (empty & bb) return nWhite;
+			int type;
+			for (type = nPawn; type < nKing && !(piece_bitboards[type] & bb); type++);
+			return type;
+		}
+
+		inline void add_piece(int type, int color, int square)
+		{
+			U64 bb = 1ULL << square;
+			piece_bitboards[type] |= bb;
+			piece_bitboards[color] |= bb;
+			empty &= ~bb;
+		}
+
+		inline void remove_piece(int type, int color, int square)
+		{
+			U64 bb = 1ULL << square;
+			piece_bitboards[type] &= ~bb;
+			piece_bitboards[color] &= ~bb;
+			empty |= bb;
+		}
+
+		inline void move_piece(int type, int color, int from, int to)
+		{
+			U64 from_to = (1ULL << from) | (1ULL << to);
+			piece_bitboards[type] ^= from_to;
+			piece_bitboards[color] ^= from_to;
+			empty ^= from_to;
+		}
+#endif
+
+		// all eight enumPiece sets at once (SIMD for the quad layout)
+		void bitboards(U64 out[8]) const;
+	};
+
+	struct Move
+	{
+		unsigned char initial_square;
+		unsigned char final_square;
+	};
+
+	struct MoveList
+	{
+		Move moves[256];
+		int count = 0;
+
+		inline void add(int initial_square, int final_square) { moves[count++] = Move{ (unsigned char)initial_square, (unsigned char)final_square }; }
+	};
+
+	const static int no_square = 64;
+
+	// pieces a make_move added, removed or moved, for incremental evaluators;
+	// from is no_square for a piece that appeared, to is no_square for one that left the board
+	struct DirtyPieces
+	{
+		struct Piece
+		{
+			unsigned char type;
+			unsigned char color;
+			unsigned char from;
+			unsigned char to;
+		};
+
+		Piece pieces[3];
+		int count = 0;
+
+		inline void add(int type, int color, int from, int to) { pieces[count++] = Piece{ (unsigned char)type, (unsigned char)color, (unsigned char)from, (unsigned char)to }; }
 	};
 
 	const static char white_piece_char[6];
@@ -92,18 +225,29 @@ public:
 	const static int bishop_direction[4];
 
 	ChessGame(Position position = starting_position);
-	ChessGame(std::string fen);
+	ChessGame(const std::string& fen);
 
-	std::map<std::string, int> position_history_3fold;
+	// position_key of every position since the last capture or pawn move, for 3-fold repetition;
+	// a fixed ring so recording a position never allocates
+	const static int history_size = 1024;
+	U64 position_history[history_size];
+	int history_count = 0;
 
 	Position current_position{};
+	enumBitbaseResult bitbase_result = BB_UNKNOWN;
 
 	void start();
-	void message(std::string);
+	void message(const std::string& message);
 	void make_move(int initial_square, int final_square);
+	static void make_move(Position& position, int initial_square, int final_square, DirtyPieces* dirty = nullptr);
 	void update_game_status();
-	static Position fen_to_pos(std::string fen);
-	static std::string pos_stringid(Position position);
+	static Position fen_to_pos(const std::string& fen);
+	// why a FEN from outside the program cannot be played, or nullptr if it can; fen_to_pos
+	// trusts its input, so it is only given FENs that pass this check
+	static const char* fen_error(const std::string& fen);
+	// hash of the piece sets and side to move, for tables keyed by whole positions
+	static U64 position_key(const Position& position);
+	static std::string pos_stringid(const Position& position);
 	inline static U64 get_bit(U64 bitboard, int square) { return bitboard &= (1ULL << square); }
 	inline static void set_bit(U64& bitboard, int square) { bitboard |= (1ULL << square); }
 	inline static U64 bitboard_union(U64 bitboard1, U64 bitboard2) { return bitboard1 | bitboard2; }
@@ -147,6 +291,35 @@ public:
 
 	static U64 attacks(Position position, bool is_black);
 
+	// Kogge-Stone occluded fills of all eight directions for every slider at once
+	// (AVX2 runs four directions per instruction when available)
+	static U64 sliding_attacks(U64 rooks, U64 bishops, U64 empty);
+	static U64 sliding_attacks_scalar(U64 rooks, U64 bishops, U64 empty);
+	static U64 slider_attacks(const Position& position, bool is_black, U64 empty);
+	static U64 leaper_attacks(const Position& position, bool is_black);
+	static void update_attack_maps(Position& position);
+	static U64 between_mask(int square1, int square2);
+
+	// fixed splitmix64 keys, so starting_position's pawn key is a compile-time constant
+	constexpr static U64 pawn_zobrist(int color, int square)
+	{
+		U64 z = 0x9E3779B97F4A7C15ULL * U64(color * 64 + square + 1);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+	constexpr static U64 pawn_key(U64 white_pawns, U64 black_pawns)
+	{
+		U64 key = 0ULL;
+		for (int square = 0; square < 64; square++)
+		{
+			if (white_pawns & (1ULL << square)) key ^= pawn_zobrist(white, square);
+			if (black_pawns & (1ULL << square)) key ^= pawn_zobrist(black, square);
+		}
+		return key;
+	}
+	inline static U64 knight_attack_set(U64 knights) { return ((knights << 6 | knights >> 10) & ~gh_file) | ((knights << 15 | knights >> 17) & ~h_file) | ((knights << 10 | knights >> 6) & ~ab_file) | ((knights << 17 | knights >> 15) & ~a_file); }
+
 	static int pop_count(U64 bitboard);
 
 	inline static U64 rank_mask(int square) { return first_rank << (square & 56); }
@@ -171,7 +344,7 @@ public:
 		| north_west_one(1ULL << square); 
 	};
 
-	inline static U64 pin_mask(Position position, bool is_black) { return queen_mask_ex(bit_scan_forward(position.piece_bitboards[nKing] & position.piece_bitboards[is_black])); }
+	inline static U64 pin_mask(Position position, bool is_black) { return queen_mask_ex(bit_scan_forward(position.pieces(nKing) & position.pieces(is_black))); }
 
 	void static print_bitboard(U64 bitboard);
 	U64 static mask_pawn_attacks(Position, bool is_black);
@@ -187,6 +360,31 @@ public:
 	U64 static anti_diag_mask(int square);
 
 
+	// Colour-specialised generators. The runtime is_black functions above dispatch to these,
+	// so shift directions and rank masks are constants inside the loops.
+	template<enumColor Us> inline static U64 pawn_push(U64 bitboard) { return Us == white ? bitboard << 8 : bitboard >> 8; }
+	template<enumColor Us> inline static U64 pawn_attack_set(U64 pawns) { return Us == white ? ((pawns << 7) & ~h_file) | ((pawns << 9) & ~a_file) : ((pawns >> 7) & ~a_file) | ((pawns >> 9) & ~h_file); }
+	template<enumColor Us> inline static U64 relative_third_rank() { return Us == white ? first_rank << 16 : first_rank << 40; }
+
+	template<enumColor Us> static U64 mask_pawn_attacks_t(const Position& position);
+	template<enumColor Us> static U64 mask_single_pushable_pawns_t(const Position& position);
+	template<enumColor Us> static U64 mask_double_pushable_pawns_t(const Position& position);
+	template<enumColor Us> static U64 mask_single_pawn_push_t(const Position& position);
+	template<enumColor Us> static U64 mask_double_pawn_push_t(const Position& position);
+	template<enumColor Us> static U64 pawn_moves_mask_t(int square, const Position& position);
+	template<enumColor Us> static U64 attackers_t(int square, const Position& position);
+	template<enumColor Us> static U64 legal_mask_t(int square, const Position& position);
+	template<enumColor Us> static U64 moves_t(int square, const Position& position, unsigned char flags);
+	template<enumColor Us> static U64 pins_t(const Position& position, int king_square, U64 pin_pieces[8], U64 pin_rays[8], int& pin_count);
+	template<enumColor Us> static void generate_moves_t(const Position& position, MoveList& list);
+	template<enumColor Us> static bool has_legal_move_t(const Position& position);
+
+	static void generate_moves(const Position& position, MoveList& list);
+	static bool has_legal_move(const Position& position);
+	// NORMAL, CHECK, CHECKMATE or STALEMATE for the side to move, stopping at the first legal move
+	static enumGameState game_state(const Position& position);
+	static U64 perft(const Position& position, int depth);
+
 	void static print_board(Position position, U64 moves = 0x0);
 	void static print_position(Position position);
 
@@ -0,0 +1,446 @@
+#include "GameServer.h"
+#include "Pgn.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <random>
+#include <algorithm>
+
+const char* const GameServer::status_names[] { "normal", "check", "checkmate", "stalemate", "repetition", "fifty-move" };
+
+void GameServer::Histogram::add(U64 ns)
+{
+	// log-linear buckets: exact below 8 ns, then eight per power of two
+	int bucket = int(ns);
+	if (ns >= 8)
+	{
+		int bits = ChessGame::bit_scan_reverse(ns) + 1;
+		bucket = (bits - 3) * 8 + int((ns >> (bits - 4)) & 7);
+	}
+
+	counts[bucket]++;
+	total++;
+	sum += ns;
+	max = std::max(max, ns);
+}
+
+void GameServer::Histogram::merge(const Histogram& other)
+{
+	for (int i = 0; i < histogram_buckets; i++) counts[i] += other.counts[i];
+	total += other.total;
+	sum += other.sum;
+	max = std::max(max, other.max);
+}
+
+U64 GameServer::Histogram::percentile(double fraction) const
+{
+	U64 rank = U64(fraction * double(total));
+	U64 seen = 0;
+
+	for (int bucket = 0; bucket < histogram_buckets; bucket++)
+	{
+		seen += counts[bucket];
+		if (seen > rank)
+		{
+			if (bucket < 8) return U64(bucket);
+			int bits = bucket / 8 + 3;
+			return std::min(max, (U64(8 + (bucket & 7)) << (bits - 4)) | ((1ULL << (bits - 4)) >> 1));
+		}
+	}
+
+	return max;
+}
+
+GameServer::GameServer(int threads, std::function<void(const std::string&)> output) : output(output)
+{
+	if (threads <= 0) threads = int(std::max(1u, std::thread::hardware_concurrency()));
+
+	writer = std::thread([this]()
+	{
+		std::unique_lock<std::mutex> lock(output_mutex);
+		for (;;)
+		{
+			output_ready.wait(lock, [&] { return !replies.empty() || writer_done; });
+			if (replies.empty()) break;
+
+			std::string line = std::move(replies.front());
+			replies.pop();
+			lock.unlock();
+
+			this->output(line);
+
+			lock.lock();
+		}
+	});
+
+	for (int t = 0; t < threads; t++) workers.emplace_back(new Worker());
+	for (int t = 0; t < threads; t++) workers[t]->thread = std::thread(&GameServer::work, this, unsigned(t));
+}
+
+GameServer::~GameServer()
+{
+	stop();
+}
+
+void GameServer::stop()
+{
+	if (stopped) return;
+	stopped = true;
+
+	for (std::unique_ptr<Worker>& worker : workers)
+	{
+		{
+			std::lock_guard<std::mutex> lock(worker->mutex);
+			worker->done = true;
+		}
+		worker->ready.notify_one();
+	}
+	for (std::unique_ptr<Worker>& worker : workers) worker->thread.join();
+
+	{
+		std::lock_guard<std::mutex> lock(output_mutex);
+		writer_done = true;
+	}
+	output_ready.notify_one();
+	writer.join();
+}
+
+void GameServer::reply(std::string line)
+{
+	{
+		std::lock_guard<std::mutex> lock(output_mutex);
+		replies.push(std::move(line));
+	}
+	output_ready.notify_one();
+}
+
+void GameServer::dispatch(unsigned int index, Request&& request)
+{
+	Worker& worker = *workers[index];
+	{
+		std::unique_lock<std::mutex> lock(worker.mutex);
+		worker.space.wait(lock, [&] { return worker.requests.size() < size_t(max_queued); });
+		worker.requests.push(std::move(request));
+	}
+	worker.ready.notify_one();
+}
+
+void GameServer::submit(const std::string& line)
+{
+	TimePoint received = std::chrono::steady_clock::now();
+
+	std::istringstream fields(line);
+	std::string verb;
+	if (!(fields >> verb)) return;
+
+	unsigned int worker_count = unsigned(workers.size());
+
+	if (verb == "new")
+	{
+		std::string fen;
+		std::getline(fields >> std::ws, fen);
+
+		unsigned int id = next_session++;
+		dispatch(id % worker_count, Request{ NEW, id, fen, received, nullptr });
+	}
+	else if (verb == "move" || verb == "moves" || verb == "close")
+	{
+		long long id = -1;
+		if (!(fields >> id) || id < 0 || id >= (long long)next_session)
+		{
+			reply("error unknown session: " + line);
+			return;
+		}
+
+		std::string argument;
+		if (!(fields >> argument) && verb == "move")
+		{
+			reply("error missing move: " + line);
+			return;
+		}
+
+		enumRequest type = verb == "move" ? MOVE : verb == "moves" ? MOVES : CLOSE;
+		dispatch(unsigned(id) % worker_count, Request{ type, unsigned(id), argument, received, nullptr });
+	}
+	else if (verb == "stats")
+	{
+		std::shared_ptr<StatsCollector> stats = std::make_shared<StatsCollector>();
+		stats->remaining = int(worker_count);
+		stats->sessions = next_session;
+		for (unsigned int w = 0; w < worker_count; w++) dispatch(w, Request{ STATS, 0, std::string(), received, stats });
+	}
+	else
+	{
+		reply("error unknown command: " + line);
+	}
+}
+
+void GameServer::work(unsigned int index)
+{
+	Worker& worker = *workers[index];
+
+	for (;;)
+	{
+		Request request;
+		{
+			std::unique_lock<std::mutex> lock(worker.mutex);
+			worker.ready.wait(lock, [&] { return !worker.requests.empty() || worker.done; });
+			if (worker.requests.empty()) break;
+			request = std::move(worker.requests.front());
+			worker.requests.pop();
+		}
+		worker.space.notify_one();
+
+		handle(worker, request);
+	}
+}
+
+void GameServer::handle(Worker& worker, Request& request)
+{
+	unsigned int worker_count = unsigned(workers.size());
+	std::string id = std::to_string(request.session);
+
+	if (request.type == STATS)
+	{
+		StatsCollector& stats = *request.stats;
+		std::lock_guard<std::mutex> lock(stats.mutex);
+
+		for (const Session& session : worker.sessions)
+		{
+			if (!session.open) continue;
+			stats.open_sessions++;
+			stats.session_bytes += sizeof(Session) + session.history.capacity() * sizeof(U64);
+		}
+		stats.moves += worker.moves;
+		stats.illegal += worker.illegal;
+		stats.validate.merge(worker.validate);
+		stats.turnaround.merge(worker.turnaround);
+
+		// the last worker to report writes the line
+		if (--stats.remaining) return;
+
+		std::ostringstream line;
+		line << std::fixed << std::setprecision(2)
+			<< "stats sessions " << stats.sessions << " open " << stats.open_sessions
+			<< " bytes/session " << (stats.open_sessions ? double(stats.session_bytes) / double(stats.open_sessions) : 0.0)
+			<< " moves " << stats.moves << " illegal " << stats.illegal;
+
+		for (int h = 0; h < 2; h++)
+		{
+			const Histogram& histogram = h ? stats.turnaround : stats.validate;
+			line << (h ? " turnaround-us" : " validate-us")
+				<< " mean " << (histogram.total ? double(histogram.sum) / double(histogram.total) / 1000.0 : 0.0)
+				<< " p50 " << double(histogram.percentile(0.50)) / 1000.0
+				<< " p99 " << double(histogram.percentile(0.99)) / 1000.0
+				<< " max " << double(histogram.max) / 1000.0;
+		}
+
+		reply(line.str());
+		return;
+	}
+
+	size_t slot = request.session / worker_count;
+
+	if (request.type == NEW)
+	{
+		if (worker.sessions.size() <= slot) worker.sessions.resize(slot + 1);
+		Session& session = worker.sessions[slot];
+
+		session.position = ChessGame::starting_position;
+		if (!request.argument.empty())
+		{
+			const char* error = ChessGame::fen_error(request.argument);
+			if (error)
+			{
+				reply(id + " error bad FEN: " + error);
+				return;
+			}
+			session.position = ChessGame::fen_to_pos(request.argument);
+		}
+		ChessGame::update_attack_maps(session.position);
+
+		session.history.clear();
+		session.history.push_back(ChessGame::position_key(session.position));
+		session.status = game_status(session);
+		session.open = true;
+
+		reply("ok " + id);
+		return;
+	}
+
+	if (slot >= worker.sessions.size() || !worker.sessions[slot].open)
+	{
+		reply(id + " error session is closed");
+		return;
+	}
+
+	Session& session = worker.sessions[slot];
+
+	if (request.type == CLOSE)
+	{
+		session.open = false;
+		std::vector<U64>().swap(session.history);
+		reply(id + " closed");
+	}
+	else if (request.type == MOVES)
+	{
+		ChessGame::MoveList list;
+		ChessGame::generate_moves(session.position, list);
+
+		std::string line = id + " moves";
+		for (int i = 0; i < list.count; i++) line += ' ' + uci(list.moves[i]);
+		reply(line);
+	}
+	else if (request.type == MOVE)
+	{
+		TimePoint start = std::chrono::steady_clock::now();
+		std::string line;
+
+		ChessGame::Move move;
+		if (session.status != PLAYING && session.status != IN_CHECK)
+		{
+			line = id + " error game over (" + status_names[session.status] + ")";
+		}
+		else if (!parse_move(session.position, request.argument, move))
+		{
+			worker.illegal++;
+			line = id + " illegal " + request.argument;
+		}
+		else
+		{
+			std::string san = Pgn::move_to_san(session.position, move);
+
+			ChessGame::make_move(session.position, move.initial_square, move.final_square);
+			if (!session.position.halfmove_clock) session.history.clear();
+			session.history.push_back(ChessGame::position_key(session.position));
+			session.status = game_status(session);
+
+			worker.moves++;
+			line = id + " ok " + uci(move) + ' ' + san + ' ' + status_names[session.status];
+		}
+
+		TimePoint end = std::chrono::steady_clock::now();
+		worker.validate.add(U64(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+		worker.turnaround.add(U64(std::chrono::duration_cast<std::chrono::nanoseconds>(end - request.received).count()));
+
+		reply(std::move(line));
+	}
+}
+
+// coordinate notation (e2e4, e7e8q) first, then SAN
+bool GameServer::parse_move(const ChessGame::Position& position, const std::string& text, ChessGame::Move& move)
+{
+	bool coordinates = (text.size() == 4 || (text.size() == 5 && text[4] == 'q'))
+		&& text[0] >= 'a' && text[0] <= 'h' && text[1] >= '1' && text[1] <= '8'
+		&& text[2] >= 'a' && text[2] <= 'h' && text[3] >= '1' && text[3] <= '8';
+
+	if (!coordinates)
+	{
+		std::string error;
+		return Pgn::san_to_move(position, text, move, error);
+	}
+
+	int from = (text[1] - '1') * 8 + (text[0] - 'a');
+	int to = (text[3] - '1') * 8 + (text[2] - 'a');
+
+	ChessGame::MoveList list;
+	ChessGame::generate_moves(position, list);
+
+	for (int i = 0; i < list.count; i++)
+	{
+		if (list.moves[i].initial_square == from && list.moves[i].final_square == to)
+		{
+			move = list.moves[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+GameServer::enumStatus GameServer::game_status(const Session& session)
+{
+	const ChessGame::Position& position = session.position;
+
+	ChessGame::enumGameState state = ChessGame::game_state(position);
+	if (state == ChessGame::CHECKMATE) return MATED;
+	if (state == ChessGame::STALEMATE) return STALEMATED;
+
+	// keys since the last irreversible move; the side to move is part of the key
+	U64 key = session.history.back();
+	if (std::count(session.history.begin(), session.history.end(), key) >= 3) return REPEATED;
+	if (position.halfmove_clock >= 100) return FIFTY_MOVES;
+
+	return state == ChessGame::CHECK ? IN_CHECK : PLAYING;
+}
+
+std::string GameServer::uci(ChessGame::Move move)
+{
+	return Pgn::square_name(move.initial_square) + Pgn::square_name(move.final_square);
+}
+
+int GameServer::run_stdio(int threads)
+{
+	std::ios::sync_with_stdio(false);
+
+	GameServer server(threads, [](const std::string& line) { std::cout << line << '\n' << std::flush; });
+
+	std::string line;
+	while (std::getline(std::cin, line))
+	{
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		if (line == "quit") break;
+		server.submit(line);
+	}
+
+	server.stop();
+	return 0;
+}
+
+void GameServer::run_load_test(int threads, int sessions, int moves_per_session, std::ostream& out)
+{
+	std::string stats_line;
+	U64 replies = 0;
+
+	GameServer server(threads, [&](const std::string& line)
+	{
+		replies++;
+		if (line.compare(0, 6, "stats ") == 0) stats_line = line;
+	});
+
+	// the client keeps its own copy of every game to pick legal moves from
+	std::vector<ChessGame::Position> games(sessions, ChessGame::starting_position);
+	std::mt19937 rng(1);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (int s = 0; s < sessions; s++) server.submit("new");
+
+	U64 submitted = 0;
+	for (int round = 0; round < moves_per_session; round++)
+	{
+		for (int s = 0; s < sessions; s++)
+		{
+			ChessGame::Position& position = games[s];
+			if (position.halfmove_clock >= 100) continue;
+
+			ChessGame::MoveList list;
+			ChessGame::generate_moves(position, list);
+			if (!list.count) continue;
+
+			ChessGame::Move move = list.moves[rng() % unsigned(list.count)];
+			server.submit("move " + std::to_string(s) + ' ' + uci(move));
+			ChessGame::make_move(position, move.initial_square, move.final_square);
+			submitted++;
+		}
+	}
+
+	server.submit("stats");
+	server.stop();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	out << "sessions: " << sessions << "  moves submitted: " << submitted << "  replies: " << replies << '\n'
+		<< "time: " << seconds << " s  (" << double(submitted) / std::max(seconds, 1e-9) << " moves/s)\n"
+		<< stats_line << '\n';
+}
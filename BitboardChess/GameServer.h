@@ -0,0 +1,153 @@
+#pragma once
+#include "ChessGame.h"
+#include <string>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <ostream>
+
+// Hosts many concurrent games behind one line protocol.
+//
+// A single I/O thread (the event loop) reads command lines and routes them to
+// the worker that owns the session (session id % workers), so each session is
+// only ever touched by one thread and its commands stay in order. Replies go
+// through a single writer thread.
+//
+//   new [fen]            -> ok <id>
+//   move <id> <move>     -> <id> ok <uci> <san> <status> | <id> illegal <move> | <id> error <reason>
+//   moves <id>           -> <id> moves <uci>...
+//   close <id>           -> <id> closed
+//   stats                -> stats ...
+//
+// moves are given as e2e4 / e7e8q or in SAN; status is one of normal, check,
+// checkmate, stalemate, repetition, fifty-move. A line that names no known session, or a
+// move command without its move, gets error <reason>: <line> with no session id.
+class GameServer
+{
+public:
+	GameServer(int threads, std::function<void(const std::string&)> output);
+	~GameServer();
+
+	// called from the event loop thread only
+	void submit(const std::string& line);
+
+	// drains every queue and joins the threads
+	void stop();
+
+	// stdin / stdout event loop, returns at end of input or on "quit"
+	static int run_stdio(int threads);
+
+	// plays random games in sessions sessions through the server and prints its stats
+	static void run_load_test(int threads, int sessions, int moves_per_session, std::ostream& out);
+
+private:
+	typedef std::chrono::steady_clock::time_point TimePoint;
+
+	const static int max_queued = 1024;		// per worker, the event loop blocks beyond this
+	const static int histogram_buckets = 64 * 8;
+
+	const enum enumStatus : unsigned char
+	{
+		PLAYING,
+		IN_CHECK,
+		MATED,
+		STALEMATED,
+		REPEATED,
+		FIFTY_MOVES
+	};
+
+	const static char* const status_names[];
+
+	// all of a session's state; history holds position keys since the last capture or pawn move
+	struct Session
+	{
+		ChessGame::Position position;
+		std::vector<U64> history;
+		enumStatus status = PLAYING;
+		bool open = false;
+	};
+
+	struct Histogram
+	{
+		U64 counts[histogram_buckets]{};
+		U64 total = 0;
+		U64 sum = 0;
+		U64 max = 0;
+
+		void add(U64 ns);
+		void merge(const Histogram& other);
+		U64 percentile(double fraction) const;
+	};
+
+	struct StatsCollector
+	{
+		std::mutex mutex;
+		int remaining;
+		U64 sessions = 0;
+		U64 open_sessions = 0;
+		U64 session_bytes = 0;
+		U64 moves = 0;
+		U64 illegal = 0;
+		Histogram validate;
+		Histogram turnaround;
+	};
+
+	const enum enumRequest
+	{
+		NEW,
+		MOVE,
+		MOVES,
+		CLOSE,
+		STATS
+	};
+
+	struct Request
+	{
+		enumRequest type;
+		unsigned int session;
+		std::string argument;
+		TimePoint received;
+		std::shared_ptr<StatsCollector> stats;
+	};
+
+	struct Worker
+	{
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::condition_variable space;
+		std::queue<Request> requests;
+		bool done = false;
+
+		std::vector<Session> sessions;	// index = session id / worker count
+		U64 moves = 0;
+		U64 illegal = 0;
+		Histogram validate;
+		Histogram turnaround;
+	};
+
+	std::function<void(const std::string&)> output;
+	std::vector<std::unique_ptr<Worker>> workers;
+	unsigned int next_session = 0;
+	bool stopped = false;
+
+	std::thread writer;
+	std::mutex output_mutex;
+	std::condition_variable output_ready;
+	std::queue<std::string> replies;
+	bool writer_done = false;
+
+	void reply(std::string line);
+	void dispatch(unsigned int worker, Request&& request);
+	void work(unsigned int index);
+	void handle(Worker& worker, Request& request);
+
+	static bool parse_move(const ChessGame::Position& position, const std::string& text, ChessGame::Move& move);
+	static enumStatus game_status(const Session& session);
+	static std::string uci(ChessGame::Move move);
+};
@@ -0,0 +1,271 @@
+#include "MatchRunner.h"
+#include "Pgn.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+const char* const MatchRunner::default_openings[]
+{
+	"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b - - 0 1",
+	"rnbqkbnr/pppppppp/8/8/3P4/8/PPP1PPPP/RNBQKBNR b - - 0 1",
+	"rnbqkbnr/pppppppp/8/8/2P5/8/PP1PPPPP/RNBQKBNR b - - 0 1",
+	"rnbqkbnr/pppppppp/8/8/8/5N2/PPPPPPPP/RNBQKB1R b - - 1 1",
+	"rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPP1PPP/RNBQKBNR w - - 0 2",
+	"rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w - - 0 2",
+	"rnbqkbnr/pppp1ppp/4p3/8/4P3/8/PPPP1PPP/RNBQKBNR w - - 0 2",
+	"rnbqkbnr/pp1ppppp/2p5/8/4P3/8/PPPP1PPP/RNBQKBNR w - - 0 2",
+	"rnbqkb1r/pppppppp/5n2/8/3P4/8/PPP1PPPP/RNBQKBNR w - - 1 2",
+	"rnbqkbnr/ppp1pppp/8/3p4/3P4/8/PPP1PPPP/RNBQKBNR w - - 0 2",
+	"r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w - - 2 3",
+	"rnbqkb1r/pppp1ppp/4pn2/8/2PP4/8/PP2PPPP/RNBQKBNR w - - 0 3",
+	nullptr
+};
+
+std::vector<std::string> MatchRunner::load_openings(const std::string& path)
+{
+	std::vector<std::string> openings;
+	std::ifstream file(path);
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		if (line.empty() || line[0] == '#') continue;
+
+		const char* error = ChessGame::fen_error(line);
+		if (error) std::cerr << "skipping opening " << line << ": " << error << std::endl;
+		else openings.push_back(line);
+	}
+
+	return openings;
+}
+
+MatchRunner::GameRecord MatchRunner::play_game(int index, const Options& options, Search engines[2])
+{
+	const std::string& fen = options.openings[(index / 2) % options.openings.size()];
+	bool a_is_white = !(index & 1);
+
+	ChessGame game(fen);
+	engines[0].clear();
+	engines[1].clear();
+
+	std::istringstream fields(fen);
+	std::string field;
+	int move_number = 1;
+	for (int i = 0; i < 6 && fields >> field; i++)
+	{
+		if (i == 5) move_number = std::max(1, std::atoi(field.c_str()));
+	}
+
+	std::string moves;
+	std::string result;
+	std::string termination;
+	int white_score = 0;	// +1 white won, -1 black won
+	U64 pawn_probes = 0;
+	U64 pawn_hits = 0;
+
+	for (int ply = 0;; ply++)
+	{
+		ChessGame::Position& position = game.current_position;
+
+		bool moves_left = ChessGame::has_legal_move(position);
+
+		if (position.state == ChessGame::CHECKMATE || (!moves_left && Pgn::in_check(position)))
+		{
+			white_score = position.color_to_move == ChessGame::white ? -1 : 1;
+			termination = "checkmate";
+			break;
+		}
+		if (position.state == ChessGame::STALEMATE || !moves_left)
+		{
+			termination = "stalemate";
+			break;
+		}
+		if (position.state == ChessGame::REPETITION)
+		{
+			termination = "3-fold repetition";
+			break;
+		}
+		if (position.halfmove_clock >= 100)
+		{
+			termination = "fifty-move rule";
+			break;
+		}
+		if (ply >= options.max_plies)
+		{
+			termination = "adjudicated after " + std::to_string(ply) + " plies";
+			break;
+		}
+
+		int engine = (position.color_to_move == ChessGame::white) == a_is_white ? 0 : 1;
+		Search::Result search = engines[engine].think(position, options.engine_limits[engine]);
+		pawn_probes += search.pawn_probes;
+		pawn_hits += search.pawn_hits;
+
+		// the position has legal moves here, so an empty move is a search bug, not something to play
+		if (!(search.best_move.initial_square | search.best_move.final_square))
+		{
+			throw std::logic_error("engine " + std::string(engine ? "B" : "A") + " returned no move in game " + std::to_string(index + 1) + " at ply " + std::to_string(ply));
+		}
+
+		if (position.color_to_move == ChessGame::white || ply == 0)
+		{
+			moves += std::to_string(move_number) + (position.color_to_move == ChessGame::white ? ". " : "... ");
+		}
+		moves += Pgn::move_to_san(position, search.best_move) + ' ';
+		if (position.color_to_move == ChessGame::black) move_number++;
+
+		game.make_move(search.best_move.initial_square, search.best_move.final_square);
+		game.update_game_status();
+	}
+
+	result = white_score > 0 ? "1-0" : white_score < 0 ? "0-1" : "1/2-1/2";
+
+	std::ostringstream pgn;
+	pgn << "[Event \"Self-play match\"]\n"
+		<< "[Site \"BitboardChess\"]\n"
+		<< "[Round \"" << index + 1 << "\"]\n"
+		<< "[White \"" << (a_is_white ? "engine A" : "engine B") << "\"]\n"
+		<< "[Black \"" << (a_is_white ? "engine B" : "engine A") << "\"]\n"
+		<< "[Result \"" << result << "\"]\n"
+		<< "[SetUp \"1\"]\n"
+		<< "[FEN \"" << fen << "\"]\n"
+		<< "[Termination \"" << termination << "\"]\n\n"
+		<< moves << result << "\n\n";
+
+	return GameRecord{ a_is_white ? white_score : -white_score, pgn.str(), pawn_probes, pawn_hits };
+}
+
+MatchRunner::Summary MatchRunner::run(const Options& options)
+{
+	Summary summary;
+	if (options.openings.empty() || options.games <= 0) return summary;
+
+	int threads = options.threads > 0 ? options.threads : int(std::max(1u, std::thread::hardware_concurrency()));
+	threads = std::min(threads, options.games);
+
+	std::ofstream pgn_file(options.pgn_path, std::ios::trunc);
+
+	std::mutex queue_mutex;
+	std::condition_variable queue_ready;
+	std::queue<GameRecord> finished;
+	bool workers_done = false;
+
+	std::atomic<int> next_game{ 0 };
+
+	// the first game to fail stops the match; its error is rethrown once the threads are done
+	std::exception_ptr error;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// the only thread touching the PGN file and the tallies
+	std::thread writer([&]()
+	{
+		std::unique_lock<std::mutex> lock(queue_mutex);
+		for (;;)
+		{
+			queue_ready.wait(lock, [&] { return !finished.empty() || workers_done; });
+			if (finished.empty()) break;
+
+			GameRecord record = std::move(finished.front());
+			finished.pop();
+			lock.unlock();
+
+			pgn_file << record.pgn;
+			pgn_file.flush();
+
+			if (record.score > 0) summary.wins++;
+			else if (record.score < 0) summary.losses++;
+			else summary.draws++;
+
+			summary.pawn_probes += record.pawn_probes;
+			summary.pawn_hits += record.pawn_hits;
+
+			lock.lock();
+		}
+	});
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++)
+	{
+		workers.emplace_back([&]()
+		{
+			// one engine pair per thread, so their tables are allocated once and not per game
+			Search engines[2];
+
+			for (int index; (index = next_game++) < options.games;)
+			{
+				GameRecord record;
+				try
+				{
+					record = play_game(index, options, engines);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(queue_mutex);
+					if (!error) error = std::current_exception();
+					next_game = options.games;
+					break;
+				}
+				{
+					std::lock_guard<std::mutex> lock(queue_mutex);
+					finished.push(std::move(record));
+				}
+				queue_ready.notify_one();
+			}
+		});
+	}
+
+	for (std::thread& worker : workers) worker.join();
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		workers_done = true;
+	}
+	queue_ready.notify_one();
+	writer.join();
+	if (error) std::rethrow_exception(error);
+
+	summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return summary;
+}
+
+void MatchRunner::print_summary(const Summary& summary, std::ostream& out)
+{
+	int games = summary.wins + summary.draws + summary.losses;
+	if (!games) return;
+
+	double score = (summary.wins + 0.5 * summary.draws) / games;
+	double variance = (summary.wins * std::pow(1.0 - score, 2) + summary.draws * std::pow(0.5 - score, 2) + summary.losses * std::pow(score, 2)) / games;
+	double margin = 1.96 * std::sqrt(variance / games);
+
+	auto elo = [](double s)
+	{
+		s = std::min(std::max(s, 1e-6), 1.0 - 1e-6);
+		return -400.0 * std::log10(1.0 / s - 1.0);
+	};
+
+	double elo_diff = elo(score);
+	double elo_low = elo(score - margin);
+	double elo_high = elo(score + margin);
+
+	out << "games: " << games << "  +" << summary.wins << " =" << summary.draws << " -" << summary.losses << '\n'
+		<< "time: " << summary.seconds << " s  (" << games / std::max(summary.seconds, 1e-9) << " games/s)\n"
+		<< "score: " << score * 100.0 << "%  elo: " << elo_diff << " +/- " << (elo_high - elo_low) / 2.0
+		<< " (95%: " << elo_low << " .. " << elo_high << ")\n";
+
+	if (summary.pawn_probes)
+	{
+		out << "pawn hash: " << summary.pawn_hits << " / " << summary.pawn_probes << " hits ("
+			<< 100.0 * double(summary.pawn_hits) / double(summary.pawn_probes) << "%)\n";
+	}
+}
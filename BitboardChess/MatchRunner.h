@@ -0,0 +1,53 @@
+#pragma once
+#include "ChessGame.h"
+#include "Search.h"
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Plays engine-vs-engine games concurrently from a list of opening FENs and
+// streams them to a PGN file through a single writer thread. Every opening is
+// played twice, once with each engine as white.
+class MatchRunner
+{
+public:
+	struct Options
+	{
+		int games = 100;
+		int threads = 0;					// 0 = one per hardware thread
+		Search::Limits engine_limits[2];	// engine A, engine B
+		std::vector<std::string> openings;
+		std::string pgn_path = "match.pgn";
+		int max_plies = 400;				// longer games are adjudicated as draws
+	};
+
+	struct Summary
+	{
+		int wins = 0;		// from engine A's point of view
+		int draws = 0;
+		int losses = 0;
+		double seconds = 0.0;
+		U64 pawn_probes = 0;	// both engines, all games
+		U64 pawn_hits = 0;
+	};
+
+	const static char* const default_openings[];
+
+	// rethrows the error of the first game that failed, after the other games in flight are done
+	static Summary run(const Options& options);
+	// one FEN per line; lines that fail ChessGame::fen_error are reported and left out
+	static std::vector<std::string> load_openings(const std::string& path);
+	static void print_summary(const Summary& summary, std::ostream& out);
+
+private:
+	struct GameRecord
+	{
+		int score;		// +1 / 0 / -1 for engine A
+		std::string pgn;
+		U64 pawn_probes;
+		U64 pawn_hits;
+	};
+
+	// engines[0] is engine A; they are the worker thread's own and are cleared before the game
+	static GameRecord play_game(int index, const Options& options, Search engines[2]);
+};
@@ -0,0 +1,358 @@
+#include "MateSolver.h"
+#include "Pgn.h"
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+const MateSolver::Entry* MateSolver::probe(U64 key, int remaining) const
+{
+	const Entry* slot = &table[bucket(key, remaining)];
+	for (int i = 0; i < bucket_size; i++)
+	{
+		if (slot[i].work && slot[i].key == key && slot[i].remaining == remaining) return &slot[i];
+	}
+	return nullptr;
+}
+
+void MateSolver::store(U64 key, int remaining, unsigned int phi, unsigned int delta, int mate, U64 work)
+{
+	Entry* slot = &table[bucket(key, remaining)];
+	Entry* victim = &slot[0];
+
+	for (int i = 0; i < bucket_size; i++)
+	{
+		if (slot[i].work && slot[i].key == key && slot[i].remaining == remaining)
+		{
+			victim = &slot[i];
+			break;
+		}
+		// older solves first, then the least work
+		bool older = slot[i].generation != generation;
+		if ((older && victim->generation == generation) || (older == (victim->generation != generation) && slot[i].work < victim->work)) victim = &slot[i];
+	}
+
+	victim->key = key;
+	victim->phi = phi;
+	victim->delta = delta;
+	victim->work = unsigned(std::min<U64>(std::max<U64>(work, 1), 0xFFFFFFFFULL));
+	victim->remaining = (unsigned char)remaining;
+	victim->mate = (unsigned char)mate;
+	victim->generation = generation;
+}
+
+void MateSolver::set_result(Child& node, int remaining, unsigned int phi, unsigned int delta, int mate, U64 work)
+{
+	node.phi = phi;
+	node.delta = delta;
+	node.mate = mate;
+	store(node.key, remaining, phi, delta, mate, work);
+}
+
+void MateSolver::mid(Child& node, int remaining, int ply, unsigned int th_phi, unsigned int th_delta)
+{
+	U64 start_nodes = nodes++;
+	if (node_limit && nodes >= node_limit) stopped = true;
+
+	const ChessGame::Position& position = node.position;
+	bool attacking = position.color_to_move == attacker;
+	bool checked = in_check(position);
+
+	// out of plies: only a defender already mated loses
+	if (!remaining)
+	{
+		bool mated = checked && !ChessGame::has_legal_move(position);
+		set_result(node, remaining, mated ? infinity : 0, mated ? 0 : infinity, 0, 1);
+		return;
+	}
+
+	ChessGame::MoveList list;
+	ChessGame::generate_moves(position, list);
+
+	if (!list.count)
+	{
+		// checkmate or an attacker without moves loses, stalemate saves the defender
+		bool lost = attacking || checked;
+		set_result(node, remaining, lost ? infinity : 0, lost ? 0 : infinity, 0, 1);
+		return;
+	}
+
+	Child* child = &children[size_t(ply) * max_children];
+	for (int i = 0; i < list.count; i++)
+	{
+		child[i].position = position;
+		ChessGame::make_move(child[i].position, list.moves[i].initial_square, list.moves[i].final_square);
+		child[i].key = key_of(child[i].position);
+		child[i].phi = 1;
+		child[i].delta = 1;
+		child[i].mate = 0;
+
+		if (attacking && !in_check(child[i].position))
+		{
+			// a quiet last move cannot mate; other quiet moves are assumed harder to prove than checks
+			if (remaining == 1)
+			{
+				child[i].phi = 0;
+				child[i].delta = infinity;
+			}
+			else
+			{
+				child[i].delta = 2;
+			}
+		}
+	}
+
+	unsigned int phi = 0;
+	unsigned int delta = 0;
+	int mate = 0;
+
+	for (;;)
+	{
+		// phi = min(child delta), delta = sum(child phi); the child with the smallest delta is expanded
+		U64 delta_sum = 0;
+		bool won = false;
+		unsigned int best_delta = infinity;
+		unsigned int second_delta = infinity;
+		int best = 0;
+		int shortest_win = 0x7FFF;
+		int longest_loss = 0;
+
+		for (int i = 0; i < list.count; i++)
+		{
+			// the table may know more through a transposition; children it has dropped keep their last values
+			const Entry* entry = probe(child[i].key, remaining - 1);
+			if (entry)
+			{
+				child[i].phi = entry->phi;
+				child[i].delta = entry->delta;
+				child[i].mate = entry->mate;
+			}
+
+			delta_sum += child[i].phi;
+			if (child[i].phi == infinity) won = true;
+			if (!child[i].delta) shortest_win = std::min(shortest_win, child[i].mate);
+			if (!child[i].phi) longest_loss = std::max(longest_loss, child[i].mate);
+
+			if (child[i].delta < best_delta)
+			{
+				second_delta = best_delta;
+				best_delta = child[i].delta;
+				best = i;
+			}
+			else if (child[i].delta < second_delta)
+			{
+				second_delta = child[i].delta;
+			}
+		}
+
+		// a lost child wins the node outright; large sums stay just below infinity
+		phi = best_delta;
+		delta = won ? infinity : unsigned(std::min<U64>(delta_sum, infinity - 1));
+
+		// plies to mate: the attacker takes the quickest win, the defender the longest loss
+		if (attacking && !phi) mate = shortest_win + 1;
+		if (!attacking && !delta) mate = longest_loss + 1;
+
+		if (phi >= th_phi || delta >= th_delta || stopped) break;
+
+		U64 child_th_phi = U64(th_delta) - delta + child[best].phi;
+		U64 child_th_delta = std::min<U64>(th_phi, U64(second_delta) + 1);
+		mid(child[best], remaining - 1, ply + 1, unsigned(std::min<U64>(child_th_phi, infinity)), unsigned(std::min<U64>(child_th_delta, infinity)));
+	}
+
+	set_result(node, remaining, phi, delta, mate, nodes - start_nodes);
+}
+
+std::vector<ChessGame::Move> MateSolver::extract_line(const ChessGame::Position& root, int limit)
+{
+	std::vector<ChessGame::Move> line;
+	ChessGame::Position position = root;
+
+	for (int remaining = limit; remaining > 0; remaining--)
+	{
+		ChessGame::MoveList list;
+		ChessGame::generate_moves(position, list);
+		if (!list.count) break;
+
+		bool attacking = position.color_to_move == attacker;
+		int best = -1;
+		int best_mate = 0;
+
+		// the attacker needs one proven child, so replaced entries are only proven again if none is left
+		for (int pass = 0; pass < 2 && best < 0; pass++)
+		{
+			for (int i = 0; i < list.count; i++)
+			{
+				Child next;
+				next.position = position;
+				ChessGame::make_move(next.position, list.moves[i].initial_square, list.moves[i].final_square);
+				next.key = key_of(next.position);
+
+				const Entry* entry = probe(next.key, remaining - 1);
+				if (entry)
+				{
+					next.phi = entry->phi;
+					next.delta = entry->delta;
+					next.mate = entry->mate;
+				}
+				else
+				{
+					if (attacking && !pass) continue;
+					mid(next, remaining - 1, int(line.size()) + 1, infinity, infinity);
+				}
+
+				if (attacking ? next.delta != 0 : next.phi != 0) continue;
+
+				// the attacker takes the quickest mate, the defender the longest
+				if (best < 0 || (attacking ? next.mate < best_mate : next.mate > best_mate))
+				{
+					best = i;
+					best_mate = next.mate;
+				}
+			}
+		}
+
+		if (best < 0) break;
+
+		line.push_back(list.moves[best]);
+		ChessGame::make_move(position, list.moves[best].initial_square, list.moves[best].final_square);
+	}
+
+	return line;
+}
+
+MateSolver::Result MateSolver::solve(const ChessGame::Position& position, const Limits& limits)
+{
+	Result result;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// entries are exact for their remaining plies, so the table is kept from one solve to the next
+	size_t entries = size_t(std::max(limits.table_mb, 1)) * 1024 * 1024 / sizeof(Entry);
+	size_t table_size = bucket_size;
+	while (table_size * 2 <= entries) table_size *= 2;
+	if (table.size() != table_size) table.assign(table_size, Entry{});
+
+	int max_plies = 2 * std::min(std::max(limits.max_moves, 1), 100) - 1;
+	children.resize(size_t(max_plies + 1) * max_children);
+
+	ChessGame::Position root = position;
+	ChessGame::update_attack_maps(root);
+
+	nodes = 0;
+	node_limit = limits.nodes;
+	stopped = false;
+	attacker = root.color_to_move;
+	generation++;
+	U64 root_key = key_of(root);
+
+	for (int limit = 1; limit <= max_plies && !stopped; limit += 2)
+	{
+		Child node;
+		node.position = root;
+		node.key = root_key;
+		mid(node, limit, 0, infinity, infinity);
+		if (stopped || node.phi) continue;
+
+		// the line comes from the table; no node limit while it is completed
+		node_limit = 0;
+		result.line = extract_line(root, limit);
+		result.mate_moves = (int(result.line.size()) + 1) / 2;
+
+		// confirm with the game's own terminal detection
+		ChessGame game(root);
+		for (ChessGame::Move move : result.line) game.make_move(move.initial_square, move.final_square);
+		game.update_game_status();
+		result.solved = game.current_position.state == ChessGame::CHECKMATE;
+		break;
+	}
+
+	result.aborted = stopped;
+	result.nodes = nodes;
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+std::string MateSolver::line_to_san(const ChessGame::Position& position, const std::vector<ChessGame::Move>& line)
+{
+	ChessGame::Position current = position;
+	std::string text;
+
+	for (ChessGame::Move move : line)
+	{
+		if (!text.empty()) text += ' ';
+		text += Pgn::move_to_san(current, move);
+		ChessGame::make_move(current, move.initial_square, move.final_square);
+	}
+
+	return text;
+}
+
+bool MateSolver::run_epd(const std::string& path, const Limits& limits, std::ostream& out)
+{
+	std::ifstream file(path);
+	if (!file) return false;
+
+	MateSolver solver;
+	std::string line;
+	int puzzles = 0;
+	int solved = 0;
+	int wrong_length = 0;
+	U64 nodes = 0;
+	double seconds = 0.0;
+
+	while (std::getline(file, line))
+	{
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		if (line.empty() || line[0] == '#') continue;
+
+		// four position fields, then "opcode operand;" pairs
+		std::istringstream fields(line);
+		std::string fen;
+		std::string field;
+		for (int i = 0; i < 4 && fields >> field; i++) fen += (i ? " " : "") + field;
+
+		std::string operations;
+		std::getline(fields, operations);
+
+		int expected = 0;
+		std::string id = "#" + std::to_string(puzzles + 1);
+		size_t dm = operations.find("dm ");
+		if (dm != std::string::npos) expected = std::atoi(operations.c_str() + dm + 3);
+		size_t id_at = operations.find("id \"");
+		if (id_at != std::string::npos) id = operations.substr(id_at + 4, operations.find('"', id_at + 4) - id_at - 4);
+
+		const char* error = ChessGame::fen_error(fen);
+		if (error)
+		{
+			out << id << ": bad EPD: " << error << '\n';
+			continue;
+		}
+		ChessGame::Position position = ChessGame::fen_to_pos(fen + " 0 1");
+
+		Result result = solver.solve(position, limits);
+		puzzles++;
+		nodes += result.nodes;
+		seconds += result.seconds;
+
+		out << id << ": ";
+		if (result.solved)
+		{
+			solved++;
+			if (expected && expected != result.mate_moves) wrong_length++;
+			out << "mate in " << result.mate_moves;
+			if (expected && expected != result.mate_moves) out << " (dm " << expected << ")";
+			out << "  " << line_to_san(position, result.line);
+		}
+		else
+		{
+			out << (result.aborted ? "node limit" : "no mate found");
+		}
+		out << "  [" << result.nodes << " nodes, " << result.seconds * 1000.0 << " ms]\n";
+	}
+
+	out << "solved " << solved << " / " << puzzles;
+	if (wrong_length) out << " (" << wrong_length << " differ from dm)";
+	out << "  time " << seconds << " s  nodes " << nodes << "  (" << U64(nodes / std::max(seconds, 1e-9)) << " nodes/s)\n";
+	return true;
+}
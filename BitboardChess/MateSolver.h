@@ -0,0 +1,93 @@
+#pragma once
+#include "ChessGame.h"
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Forced-mate solver using depth-first proof-number search (df-pn).
+//
+// The side to move at the root is the attacker. An attacker node is proven when one
+// move leads to a proven defender node, a defender node when every reply does. A side
+// with no legal moves loses the node if it is the attacker or in check, so checkmate
+// proves it and stalemate disproves it. Every node keeps the proof and disproof numbers
+// of its own side to move as (phi, delta), so both node kinds share one code path.
+//
+// The search is repeated with a growing limit of 1, 3, 5 ... plies, so the first limit
+// that proves the root is the shortest mate. Nodes are stored by key and remaining plies
+// in a fixed-size table of four-entry buckets; a full bucket gives up the entry with the
+// least work below it. The table is kept across solves, and entries from earlier solves
+// are replaced first.
+class MateSolver
+{
+public:
+	struct Limits
+	{
+		int max_moves = 8;				// longest mate looked for, in attacker moves
+		U64 nodes = 0;					// 0 = no node limit
+		int table_mb = 16;				// rounded down to a power of two entries
+	};
+
+	struct Result
+	{
+		bool solved = false;			// a mate was proven and replays to CHECKMATE
+		bool aborted = false;			// the node limit stopped the search
+		int mate_moves = 0;				// attacker moves to mate
+		std::vector<ChessGame::Move> line;	// both sides' moves, ending in checkmate
+		U64 nodes = 0;
+		double seconds = 0.0;
+	};
+
+	Result solve(const ChessGame::Position& position, const Limits& limits);
+
+	// Solves every position of an EPD file ("dm N" is checked when present) and prints
+	// one line per puzzle and a summary. Returns false if the file cannot be opened.
+	static bool run_epd(const std::string& path, const Limits& limits, std::ostream& out);
+
+	static std::string line_to_san(const ChessGame::Position& position, const std::vector<ChessGame::Move>& line);
+
+private:
+	struct Entry
+	{
+		U64 key = 0ULL;
+		unsigned int phi = 0;
+		unsigned int delta = 0;
+		unsigned int work = 0;		// nodes searched below the entry, 0 = empty slot
+		unsigned char remaining = 0;	// plies left to the mate limit
+		unsigned char mate = 0;		// plies to mate once proven
+		unsigned short generation = 0;	// solve that wrote the entry
+	};
+
+	// a node on the search stack; it keeps its own numbers, so a child the table has
+	// dropped is not searched again from scratch while its parent is still working
+	struct Child
+	{
+		ChessGame::Position position;
+		U64 key = 0ULL;
+		unsigned int phi = 1;
+		unsigned int delta = 1;
+		int mate = 0;
+	};
+
+	const static unsigned int infinity = 1u << 30;
+	const static int bucket_size = 4;
+	const static int max_children = 256;
+
+	std::vector<Entry> table;
+	std::vector<Child> children;	// max_children per ply, alongside the search stack
+	U64 nodes = 0;
+	U64 node_limit = 0;
+	bool stopped = false;
+	int attacker = ChessGame::white;
+	unsigned short generation = 0;
+
+	void mid(Child& node, int remaining, int ply, unsigned int th_phi, unsigned int th_delta);
+	void set_result(Child& node, int remaining, unsigned int phi, unsigned int delta, int mate, U64 work);
+	const Entry* probe(U64 key, int remaining) const;
+	void store(U64 key, int remaining, unsigned int phi, unsigned int delta, int mate, U64 work);
+	std::vector<ChessGame::Move> extract_line(const ChessGame::Position& position, int limit);
+
+	// a node's value depends on who is mating, so the attacker is part of the key
+	inline U64 key_of(const ChessGame::Position& position) const { return ChessGame::position_key(position) ^ (attacker == ChessGame::black ? 0xD6E8FEB86659FD93ULL : 0ULL); }
+	inline size_t bucket(U64 key, int remaining) const { return size_t((key ^ (U64(remaining) * 0x9E3779B97F4A7C15ULL)) & (table.size() - 1)) & ~size_t(bucket_size - 1); }
+	inline static bool in_check(const ChessGame::Position& position) { return position.pieces(ChessGame::nKing) & position.pieces(position.color_to_move) & position.attack_maps[!position.color_to_move]; }
+};
@@ -0,0 +1,221 @@
+#include "Nnue.h"
+#include <fstream>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NNUE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NNUE_SSE2
+#endif
+
+std::vector<short> Nnue::feature_biases;
+std::vector<short> Nnue::feature_weights;
+std::vector<int> Nnue::l1_biases;
+std::vector<short> Nnue::l1_weights;
+int Nnue::l2_bias = 0;
+std::vector<short> Nnue::l2_weights;
+U64 Nnue::network_checksum = 0ULL;
+
+namespace
+{
+	const int max_rows = 3;
+
+	// FNV-1a over the bytes of one parameter block
+	inline U64 checksum_bytes(U64 hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+		return hash;
+	}
+
+	// out = in + sum(add rows) - sum(sub rows), one pass over the accumulator
+	inline void apply_rows(const short* in, short* out, const short* const* add, int add_count, const short* const* sub, int sub_count)
+	{
+#if defined(NNUE_AVX2)
+		for (int i = 0; i < Nnue::hidden; i += 16)
+		{
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+			for (int r = 0; r < add_count; r++) v = _mm256_add_epi16(v, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(add[r] + i)));
+			for (int r = 0; r < sub_count; r++) v = _mm256_sub_epi16(v, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sub[r] + i)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), v);
+		}
+#elif defined(NNUE_SSE2)
+		for (int i = 0; i < Nnue::hidden; i += 8)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			for (int r = 0; r < add_count; r++) v = _mm_add_epi16(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(add[r] + i)));
+			for (int r = 0; r < sub_count; r++) v = _mm_sub_epi16(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(sub[r] + i)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v);
+		}
+#else
+		for (int i = 0; i < Nnue::hidden; i++)
+		{
+			int v = in[i];
+			for (int r = 0; r < add_count; r++) v += add[r][i];
+			for (int r = 0; r < sub_count; r++) v -= sub[r][i];
+			out[i] = short(v);
+		}
+#endif
+	}
+
+	// clipped ReLU of both accumulator halves into one input vector
+	inline void clip(const short* first, const short* second, short* out)
+	{
+#if defined(NNUE_AVX2)
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i top = _mm256_set1_epi16(Nnue::activation_max);
+		for (int i = 0; i < Nnue::hidden; i += 16)
+		{
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + i)), zero), top));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + Nnue::hidden + i), _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + i)), zero), top));
+		}
+#elif defined(NNUE_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i top = _mm_set1_epi16(Nnue::activation_max);
+		for (int i = 0; i < Nnue::hidden; i += 8)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_min_epi16(_mm_max_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i)), zero), top));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + Nnue::hidden + i), _mm_min_epi16(_mm_max_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(second + i)), zero), top));
+		}
+#else
+		for (int i = 0; i < Nnue::hidden; i++)
+		{
+			out[i] = short(std::min<int>(std::max<int>(first[i], 0), Nnue::activation_max));
+			out[Nnue::hidden + i] = short(std::min<int>(std::max<int>(second[i], 0), Nnue::activation_max));
+		}
+#endif
+	}
+
+	// int16 dot product with int32 accumulation; size is a multiple of 16
+	inline int dot(const short* a, const short* b, int size)
+	{
+#if defined(NNUE_AVX2)
+		__m256i sum = _mm256_setzero_si256();
+		for (int i = 0; i < size; i += 16)
+		{
+			sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i))));
+		}
+		__m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+		return _mm_cvtsi128_si32(half);
+#elif defined(NNUE_SSE2)
+		__m128i sum = _mm_setzero_si128();
+		for (int i = 0; i < size; i += 8)
+		{
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))));
+		}
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+		return _mm_cvtsi128_si32(sum);
+#else
+		int sum = 0;
+		for (int i = 0; i < size; i++) sum += a[i] * b[i];
+		return sum;
+#endif
+	}
+}
+
+bool Nnue::load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return false;
+
+	char magic[4];
+	unsigned int header[4];
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+
+	if (!file || std::string(magic, 4) != "BBNN" || header[0] != file_version || header[1] != unsigned(inputs) || header[2] != unsigned(hidden) || header[3] != unsigned(l1_size)) return false;
+
+	std::vector<short> new_feature_biases(hidden);
+	std::vector<short> new_feature_weights(inputs * hidden);
+	std::vector<int> new_l1_biases(l1_size);
+	std::vector<short> new_l1_weights(l1_size * 2 * hidden);
+	int new_l2_bias;
+	std::vector<short> new_l2_weights(l1_size);
+
+	file.read(reinterpret_cast<char*>(new_feature_biases.data()), new_feature_biases.size() * sizeof(short));
+	file.read(reinterpret_cast<char*>(new_feature_weights.data()), new_feature_weights.size() * sizeof(short));
+	file.read(reinterpret_cast<char*>(new_l1_biases.data()), new_l1_biases.size() * sizeof(int));
+	file.read(reinterpret_cast<char*>(new_l1_weights.data()), new_l1_weights.size() * sizeof(short));
+	file.read(reinterpret_cast<char*>(&new_l2_bias), sizeof(int));
+	file.read(reinterpret_cast<char*>(new_l2_weights.data()), new_l2_weights.size() * sizeof(short));
+	if (!file) return false;
+
+	feature_biases.swap(new_feature_biases);
+	feature_weights.swap(new_feature_weights);
+	l1_biases.swap(new_l1_biases);
+	l1_weights.swap(new_l1_weights);
+	l2_bias = new_l2_bias;
+	l2_weights.swap(new_l2_weights);
+
+	U64 hash = 0xCBF29CE484222325ULL;
+	hash = checksum_bytes(hash, feature_biases.data(), feature_biases.size() * sizeof(short));
+	hash = checksum_bytes(hash, feature_weights.data(), feature_weights.size() * sizeof(short));
+	hash = checksum_bytes(hash, l1_biases.data(), l1_biases.size() * sizeof(int));
+	hash = checksum_bytes(hash, l1_weights.data(), l1_weights.size() * sizeof(short));
+	hash = checksum_bytes(hash, &l2_bias, sizeof(int));
+	network_checksum = checksum_bytes(hash, l2_weights.data(), l2_weights.size() * sizeof(short));
+	return true;
+}
+
+void Nnue::refresh(const ChessGame::Position& position, Accumulator& accumulator)
+{
+	for (int perspective = ChessGame::white; perspective <= ChessGame::black; perspective++)
+	{
+		short* values = accumulator.values[perspective];
+		std::copy(feature_biases.begin(), feature_biases.end(), values);
+
+		for (int type = ChessGame::nPawn; type <= ChessGame::nKing; type++)
+		{
+			for (int color = ChessGame::white; color <= ChessGame::black; color++)
+			{
+				for (U64 bb = position.pieces(type) & position.pieces(color); bb; bb &= bb - 1)
+				{
+					const short* row = &feature_weights[feature(perspective, type, color, ChessGame::bit_scan_forward(bb)) * hidden];
+					apply_rows(values, values, &row, 1, nullptr, 0);
+				}
+			}
+		}
+	}
+}
+
+void Nnue::update(const Accumulator& parent, Accumulator& child, const ChessGame::DirtyPieces& dirty)
+{
+	for (int perspective = ChessGame::white; perspective <= ChessGame::black; perspective++)
+	{
+		const short* add[max_rows];
+		const short* sub[max_rows];
+		int add_count = 0;
+		int sub_count = 0;
+
+		for (int i = 0; i < dirty.count; i++)
+		{
+			const ChessGame::DirtyPieces::Piece& piece = dirty.pieces[i];
+			if (piece.from != ChessGame::no_square) sub[sub_count++] = &feature_weights[feature(perspective, piece.type, piece.color, piece.from) * hidden];
+			if (piece.to != ChessGame::no_square) add[add_count++] = &feature_weights[feature(perspective, piece.type, piece.color, piece.to) * hidden];
+		}
+
+		apply_rows(parent.values[perspective], child.values[perspective], add, add_count, sub, sub_count);
+	}
+}
+
+int Nnue::evaluate(const ChessGame::Position& position, const Accumulator& accumulator)
+{
+	alignas(32) short input[2 * hidden];
+	alignas(32) short l1_output[l1_size];
+
+	int us = position.color_to_move;
+	clip(accumulator.values[us], accumulator.values[!us], input);
+
+	for (int o = 0; o < l1_size; o++)
+	{
+		int sum = (l1_biases[o] + dot(input, &l1_weights[o * 2 * hidden], 2 * hidden)) >> l1_shift;
+		l1_output[o] = short(std::min(std::max(sum, 0), activation_max));
+	}
+
+	return (l2_bias + dot(l1_output, l2_weights.data(), l1_size)) / output_scale;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "ChessGame.h"
+#include <string>
+#include <vector>
+
+// Efficiently updatable network evaluation.
+//
+// 768 piece-square inputs (own/enemy x piece type x square, seen from each side)
+// feed a 256-wide int16 feature transformer. Each side keeps its own half of the
+// accumulator, and a move only adds and subtracts the rows of the pieces in its
+// DirtyPieces. Both halves, side to move first, are clipped to 0..127 and go
+// through a 512 -> 32 -> 1 integer network.
+//
+// file: "BBNN", version, inputs, hidden, l1 size, then feature biases, feature
+// weights (one row of hidden per input), l1 biases, l1 weights (one row of 2 * hidden
+// per output), l2 bias and l2 weights, all little-endian
+class Nnue
+{
+public:
+	constexpr static int inputs = 768;
+	constexpr static int hidden = 256;
+	constexpr static int l1_size = 32;
+	constexpr static int activation_max = 127;
+	constexpr static int l1_shift = 6;			// l1 outputs are scaled back to the activation range
+	constexpr static int output_scale = 16;		// network units per centipawn
+
+	constexpr static unsigned int file_version = 1;
+
+	struct alignas(32) Accumulator
+	{
+		short values[2][hidden];	// white's and black's perspective
+	};
+
+	static bool load(const std::string& path);
+	static bool is_loaded() { return !feature_weights.empty(); }
+	// a hash of the loaded weights, so results of different networks can be told apart
+	static U64 checksum() { return network_checksum; }
+
+	static void refresh(const ChessGame::Position& position, Accumulator& accumulator);
+	static void update(const Accumulator& parent, Accumulator& child, const ChessGame::DirtyPieces& dirty);
+
+	// centipawns from the side to move's point of view
+	static int evaluate(const ChessGame::Position& position, const Accumulator& accumulator);
+
+private:
+	static std::vector<short> feature_biases;
+	static std::vector<short> feature_weights;
+	static std::vector<int> l1_biases;
+	static std::vector<short> l1_weights;
+	static int l2_bias;
+	static std::vector<short> l2_weights;
+	static U64 network_checksum;
+
+	inline static int feature(int perspective, int type, int color, int square)
+	{
+		return ((color != perspective) * 6 + (type - ChessGame::nPawn)) * 64 + (perspective == ChessGame::white ? square : square ^ 56);
+	}
+};
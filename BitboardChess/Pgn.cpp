@@ -0,0 +1,169 @@
+#include "Pgn.h"
+
+namespace
+{
+	const char san_piece_char[8] { 0, 0, 0, 'R', 'N', 'B', 'Q', 'K' };
+}
+
+std::string Pgn::square_name(int square)
+{
+	return std::string{ char('a' + (square & 7)), char('1' + (square >> 3)) };
+}
+
+bool Pgn::in_check(const ChessGame::Position& position)
+{
+	bool is_black = position.color_to_move;
+	return position.pieces(ChessGame::nKing) & position.pieces(is_black) & position.attack_maps[!is_black];
+}
+
+std::string Pgn::move_to_san(const ChessGame::Position& position, ChessGame::Move move)
+{
+	U64 from_bb = 1ULL << move.initial_square;
+	U64 to_bb = 1ULL << move.final_square;
+	bool capture = to_bb & ~position.empty_squares();
+
+	int type;
+	for (type = ChessGame::nPawn; type < ChessGame::nKing && !(position.pieces(type) & from_bb); type++);
+
+	std::string san;
+
+	if (type == ChessGame::nPawn)
+	{
+		if (capture) san += char('a' + (move.initial_square & 7));
+	}
+	else
+	{
+		san += san_piece_char[type];
+
+		// disambiguate against other pieces of the same type that can reach the square
+		ChessGame::MoveList list;
+		ChessGame::generate_moves(position, list);
+
+		bool ambiguous = false, same_file = false, same_rank = false;
+		for (int i = 0; i < list.count; i++)
+		{
+			const ChessGame::Move& other = list.moves[i];
+			if (other.final_square != move.final_square || other.initial_square == move.initial_square) continue;
+			if (!(position.pieces(type) & (1ULL << other.initial_square))) continue;
+
+			ambiguous = true;
+			same_file |= (other.initial_square & 7) == (move.initial_square & 7);
+			same_rank |= (other.initial_square >> 3) == (move.initial_square >> 3);
+		}
+
+		if (ambiguous)
+		{
+			if (!same_file) san += char('a' + (move.initial_square & 7));
+			else if (!same_rank) san += char('1' + (move.initial_square >> 3));
+			else san += square_name(move.initial_square);
+		}
+	}
+
+	if (capture) san += 'x';
+	san += square_name(move.final_square);
+
+	if (type == ChessGame::nPawn && (to_bb & (ChessGame::first_rank | ChessGame::eighth_rank))) san += "=Q";
+
+	ChessGame::Position next = position;
+	ChessGame::make_move(next, move.initial_square, move.final_square);
+
+	if (in_check(next)) san += ChessGame::has_legal_move(next) ? '+' : '#';
+
+	return san;
+}
+
+bool Pgn::san_to_move(const ChessGame::Position& position, const std::string& san, ChessGame::Move& move, std::string& error)
+{
+	std::string text = san;
+	while (!text.empty() && (text.back() == '+' || text.back() == '#' || text.back() == '!' || text.back() == '?')) text.pop_back();
+
+	if (text.empty())
+	{
+		error = "empty move";
+		return false;
+	}
+
+	if (text.compare(0, 3, "O-O") == 0 || text.compare(0, 3, "0-0") == 0)
+	{
+		error = "castling is not supported: " + san;
+		return false;
+	}
+
+	int type = ChessGame::nPawn;
+	size_t pos = 0;
+
+	switch (text[0])
+	{
+	case 'R': type = ChessGame::nRook; pos++; break;
+	case 'N': type = ChessGame::nKnight; pos++; break;
+	case 'B': type = ChessGame::nBishop; pos++; break;
+	case 'Q': type = ChessGame::nQueen; pos++; break;
+	case 'K': type = ChessGame::nKing; pos++; break;
+	default: break;
+	}
+
+	size_t promotion = text.find('=');
+	if (promotion != std::string::npos)
+	{
+		if (promotion + 1 >= text.size() || text[promotion + 1] != 'Q')
+		{
+			error = "under-promotion is not supported: " + san;
+			return false;
+		}
+		text.erase(promotion);
+	}
+
+	// what is left is [file][rank][x]square
+	if (text.size() < pos + 2)
+	{
+		error = "cannot parse move: " + san;
+		return false;
+	}
+
+	char to_file = text[text.size() - 2];
+	char to_rank = text[text.size() - 1];
+	if (to_file < 'a' || to_file > 'h' || to_rank < '1' || to_rank > '8')
+	{
+		error = "cannot parse move: " + san;
+		return false;
+	}
+	int final_square = (to_rank - '1') * 8 + (to_file - 'a');
+
+	int from_file = -1;
+	int from_rank = -1;
+	for (size_t i = pos; i + 2 < text.size(); i++)
+	{
+		char c = text[i];
+		if (c >= 'a' && c <= 'h') from_file = c - 'a';
+		else if (c >= '1' && c <= '8') from_rank = c - '1';
+		else if (c != 'x' && c != ':')
+		{
+			error = "cannot parse move: " + san;
+			return false;
+		}
+	}
+
+	ChessGame::MoveList list;
+	ChessGame::generate_moves(position, list);
+
+	int matches = 0;
+	for (int i = 0; i < list.count; i++)
+	{
+		const ChessGame::Move& candidate = list.moves[i];
+		if (candidate.final_square != final_square) continue;
+		if (!(position.pieces(type) & (1ULL << candidate.initial_square))) continue;
+		if (from_file >= 0 && (candidate.initial_square & 7) != from_file) continue;
+		if (from_rank >= 0 && (candidate.initial_square >> 3) != from_rank) continue;
+
+		move = candidate;
+		matches++;
+	}
+
+	if (matches == 1) return true;
+
+	if (matches > 1) error = "ambiguous move: " + san;
+	else if (type == ChessGame::nPawn && from_file >= 0 && (position.empty_squares() & (1ULL << final_square))) error = "en passant is not supported: " + san;
+	else error = "illegal move: " + san;
+
+	return false;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "ChessGame.h"
+#include <string>
+
+// Standard algebraic notation and PGN helpers.
+class Pgn
+{
+public:
+	static std::string square_name(int square);
+	static std::string move_to_san(const ChessGame::Position& position, ChessGame::Move move);
+
+	// Resolves san against the legal moves of position. Returns false and fills error
+	// for unparsable, illegal, ambiguous or unsupported (castling, en passant, under-promotion) moves.
+	static bool san_to_move(const ChessGame::Position& position, const std::string& san, ChessGame::Move& move, std::string& error);
+	static bool in_check(const ChessGame::Position& position);
+};
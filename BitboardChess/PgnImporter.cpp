@@ -0,0 +1,431 @@
+#include "PgnImporter.h"
+#include "Pgn.h"
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+bool PgnImporter::is_result(const std::string& token)
+{
+	return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+}
+
+bool PgnImporter::replay(const std::string& text, U64& plies, std::string& error)
+{
+	std::string fen;
+	std::string tag_result;
+	std::string movetext_result;
+	std::vector<std::string> sans;
+
+	size_t i = 0;
+	size_t n = text.size();
+	int variation_depth = 0;
+
+	// tokenize: tag pairs, then movetext with comments, variations and NAGs dropped
+	while (i < n)
+	{
+		char c = text[i];
+
+		if (std::isspace(static_cast<unsigned char>(c)))
+		{
+			i++;
+		}
+		else if (c == '{')
+		{
+			size_t end = text.find('}', i);
+			if (end == std::string::npos)
+			{
+				error = "unterminated comment";
+				return false;
+			}
+			i = end + 1;
+		}
+		else if (c == ';' || (c == '%' && (i == 0 || text[i - 1] == '\n')))
+		{
+			size_t end = text.find('\n', i);
+			i = end == std::string::npos ? n : end + 1;
+		}
+		else if (c == '(')
+		{
+			variation_depth++;
+			i++;
+		}
+		else if (c == ')')
+		{
+			if (--variation_depth < 0)
+			{
+				error = "unbalanced variation";
+				return false;
+			}
+			i++;
+		}
+		else if (c == '[' && !variation_depth)
+		{
+			size_t name_end = i + 1;
+			while (name_end < n && !std::isspace(static_cast<unsigned char>(text[name_end])) && text[name_end] != ']') name_end++;
+			std::string name = text.substr(i + 1, name_end - i - 1);
+
+			size_t quote = text.find('"', name_end);
+			std::string value;
+			size_t k = quote == std::string::npos ? n : quote + 1;
+			for (; k < n && text[k] != '"'; k++)
+			{
+				if (text[k] == '\\' && k + 1 < n) k++;
+				value += text[k];
+			}
+
+			size_t end = k < n ? text.find(']', k) : std::string::npos;
+			if (end == std::string::npos)
+			{
+				error = "malformed tag pair";
+				return false;
+			}
+
+			if (name == "FEN") fen = value;
+			else if (name == "Result") tag_result = value;
+
+			i = end + 1;
+		}
+		else if (c == '$')
+		{
+			for (i++; i < n && std::isdigit(static_cast<unsigned char>(text[i])); i++);
+		}
+		else
+		{
+			size_t end = i;
+			while (end < n && !std::isspace(static_cast<unsigned char>(text[end])) && !std::strchr("{}();[]$", text[end])) end++;
+			if (end == i) end++;
+			std::string token = text.substr(i, end - i);
+			i = end;
+
+			if (variation_depth) continue;
+
+			if (is_result(token))
+			{
+				movetext_result = token;
+				continue;
+			}
+
+			// move numbers: "12." "12..." and "12.e4"
+			size_t start = 0;
+			if (std::isdigit(static_cast<unsigned char>(token[0])) && token.compare(0, 3, "0-0") != 0)
+			{
+				while (start < token.size() && std::isdigit(static_cast<unsigned char>(token[start]))) start++;
+				if (start == token.size() || token[start] != '.')
+				{
+					error = "unexpected token: " + token;
+					return false;
+				}
+			}
+			while (start < token.size() && token[start] == '.') start++;
+
+			if (start < token.size()) sans.push_back(token.substr(start));
+		}
+	}
+
+	if (variation_depth)
+	{
+		error = "unbalanced variation";
+		return false;
+	}
+
+	ChessGame::Position start = ChessGame::starting_position;
+	if (!fen.empty())
+	{
+		const char* fen_error = ChessGame::fen_error(fen);
+		if (fen_error)
+		{
+			error = "bad FEN (" + std::string(fen_error) + "): " + fen;
+			return false;
+		}
+		start = ChessGame::fen_to_pos(fen);
+	}
+
+	// the constructor has already recorded the start position for repetitions, so it is only classified here
+	ChessGame game(start);
+	game.current_position.state = ChessGame::game_state(game.current_position);
+
+	for (size_t ply = 0; ply < sans.size(); ply++)
+	{
+		const std::string& san = sans[ply];
+		ChessGame::Position& position = game.current_position;
+
+		if (position.state == ChessGame::CHECKMATE || position.state == ChessGame::STALEMATE)
+		{
+			error = "ply " + std::to_string(ply + 1) + ": move after " + (position.state == ChessGame::CHECKMATE ? "checkmate" : "stalemate") + ": " + san;
+			return false;
+		}
+
+		ChessGame::Move move;
+		std::string move_error;
+		if (!Pgn::san_to_move(position, san, move, move_error))
+		{
+			error = "ply " + std::to_string(ply + 1) + ": " + move_error;
+			return false;
+		}
+
+		game.make_move(move.initial_square, move.final_square);
+		game.update_game_status();
+		plies++;
+
+		if (san.back() == '#' && game.current_position.state != ChessGame::CHECKMATE)
+		{
+			error = "ply " + std::to_string(ply + 1) + ": " + san + " is not checkmate";
+			return false;
+		}
+	}
+
+	if (!tag_result.empty() && !movetext_result.empty() && tag_result != movetext_result)
+	{
+		error = "Result tag " + tag_result + " does not match movetext " + movetext_result;
+		return false;
+	}
+
+	const std::string& result = movetext_result.empty() ? tag_result : movetext_result;
+	const ChessGame::Position& final_position = game.current_position;
+	std::string expected;
+
+	if (final_position.state == ChessGame::CHECKMATE) expected = final_position.color_to_move == ChessGame::white ? "0-1" : "1-0";
+	else if (final_position.state == ChessGame::STALEMATE) expected = "1/2-1/2";
+
+	if (!expected.empty() && !result.empty() && result != "*" && result != expected)
+	{
+		error = "result " + result + " does not match the final position (" + expected + ")";
+		return false;
+	}
+
+	return true;
+}
+
+PgnImporter::Summary PgnImporter::run(const std::string& path, const Options& options)
+{
+	Summary summary;
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return summary;
+	summary.opened = true;
+
+	int threads = options.threads > 0 ? options.threads : int(std::max(1u, std::thread::hardware_concurrency()));
+	size_t chunk_size = std::max<size_t>(options.chunk_size, 1);
+	size_t batch_size = size_t(std::max(options.batch_size, 1));
+	size_t max_errors = size_t(std::max(options.max_errors, 0));
+
+	// a few batches per worker in flight keeps memory bounded however big the file is
+	size_t max_queued = size_t(threads) * 4;
+
+	std::mutex queue_mutex;
+	std::condition_variable queue_ready;
+	std::condition_variable queue_space;
+	std::queue<Batch> batches;
+	bool reader_done = false;
+
+	std::atomic<U64> valid{ 0 };
+	std::atomic<U64> malformed{ 0 };
+	std::atomic<U64> plies{ 0 };
+	std::mutex errors_mutex;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++)
+	{
+		workers.emplace_back([&]()
+		{
+			for (;;)
+			{
+				Batch batch;
+				{
+					std::unique_lock<std::mutex> lock(queue_mutex);
+					queue_ready.wait(lock, [&] { return !batches.empty() || reader_done; });
+					if (batches.empty()) break;
+					batch = std::move(batches.front());
+					batches.pop();
+				}
+				queue_space.notify_one();
+
+				U64 batch_valid = 0;
+				U64 batch_plies = 0;
+
+				for (size_t g = 0; g < batch.games.size(); g++)
+				{
+					std::string error;
+					if (replay(batch.games[g], batch_plies, error))
+					{
+						batch_valid++;
+						continue;
+					}
+
+					malformed++;
+					if (!max_errors) continue;
+
+					// keep the earliest games; workers finish out of order
+					std::lock_guard<std::mutex> lock(errors_mutex);
+					summary.errors.push_back(GameError{ batch.first_game + g, error });
+					if (summary.errors.size() >= 2 * max_errors)
+					{
+						std::sort(summary.errors.begin(), summary.errors.end(), [](const GameError& a, const GameError& b) { return a.game < b.game; });
+						summary.errors.resize(max_errors);
+					}
+				}
+
+				valid += batch_valid;
+				plies += batch_plies;
+			}
+		});
+	}
+
+	auto push = [&](Batch&& batch)
+	{
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			queue_space.wait(lock, [&] { return batches.size() < max_queued; });
+			batches.push(std::move(batch));
+		}
+		queue_ready.notify_one();
+	};
+
+	// the reader cuts games at a tag line that follows movetext, unless the line is inside a { } comment
+	U64 game_count = 0;
+	Batch batch{ 1, {} };
+	std::string game;
+	bool in_movetext = false;
+	bool in_comment = false;
+
+	auto emit = [&]()
+	{
+		if (game.find_first_not_of(" \t\r\n") != std::string::npos)
+		{
+			batch.games.push_back(std::move(game));
+			game_count++;
+			if (batch.games.size() >= batch_size)
+			{
+				push(std::move(batch));
+				batch = Batch{ game_count + 1, {} };
+			}
+		}
+		game.clear();
+		in_movetext = false;
+	};
+
+	auto add_line = [&](const char* begin, const char* end)
+	{
+		if (end > begin && end[-1] == '\r') end--;
+
+		const char* first = begin;
+		while (first < end && (*first == ' ' || *first == '\t')) first++;
+
+		if (first < end && !in_comment)
+		{
+			if (*first == '[')
+			{
+				if (in_movetext) emit();
+			}
+			else if (*first != '%')
+			{
+				in_movetext = true;
+			}
+		}
+
+		// brace comments can span lines; tag and escape lines are not movetext, and ';' comments end the line
+		if (first < end && (in_comment || (*first != '[' && *first != '%')))
+		{
+			for (const char* c = first; c < end; c++)
+			{
+				if (in_comment)
+				{
+					if (*c == '}') in_comment = false;
+				}
+				else if (*c == '{')
+				{
+					in_comment = true;
+				}
+				else if (*c == ';')
+				{
+					break;
+				}
+			}
+		}
+
+		game.append(begin, end);
+		game.push_back('\n');
+	};
+
+	std::vector<char> buffer(chunk_size);
+	std::string carry;
+
+	while (file)
+	{
+		file.read(buffer.data(), std::streamsize(chunk_size));
+		size_t got = size_t(file.gcount());
+		if (!got) break;
+
+		const char* p = buffer.data();
+		const char* end = p + got;
+
+		for (;;)
+		{
+			const char* newline = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+			if (!newline)
+			{
+				carry.append(p, end);
+				break;
+			}
+
+			if (carry.empty())
+			{
+				add_line(p, newline);
+			}
+			else
+			{
+				carry.append(p, newline);
+				add_line(carry.data(), carry.data() + carry.size());
+				carry.clear();
+			}
+			p = newline + 1;
+		}
+	}
+
+	if (!carry.empty()) add_line(carry.data(), carry.data() + carry.size());
+	emit();
+	if (!batch.games.empty()) push(std::move(batch));
+
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		reader_done = true;
+	}
+	queue_ready.notify_all();
+	for (std::thread& worker : workers) worker.join();
+
+	std::sort(summary.errors.begin(), summary.errors.end(), [](const GameError& a, const GameError& b) { return a.game < b.game; });
+	if (summary.errors.size() > max_errors) summary.errors.resize(max_errors);
+
+	summary.games = game_count;
+	summary.valid = valid;
+	summary.malformed = malformed;
+	summary.plies = plies;
+	summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return summary;
+}
+
+void PgnImporter::print_summary(const Summary& summary, std::ostream& out)
+{
+	double seconds = std::max(summary.seconds, 1e-9);
+
+	out << "games: " << summary.games << "  valid: " << summary.valid << "  malformed: " << summary.malformed << '\n'
+		<< "time: " << summary.seconds << " s  (" << summary.games / seconds << " games/s, " << summary.plies / seconds << " plies/s)\n";
+
+	for (const GameError& error : summary.errors)
+	{
+		out << "  game " << error.game << ": " << error.message << '\n';
+	}
+	if (summary.malformed > summary.errors.size())
+	{
+		out << "  ... and " << summary.malformed - summary.errors.size() << " more\n";
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "ChessGame.h"
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Replays a PGN database against the rules engine. The file is read in fixed
+// size chunks and cut into games by a single reader thread; batches of games
+// are decoded on a worker pool. Malformed or unsupported games are counted and
+// the first few are reported, the run never stops on them.
+class PgnImporter
+{
+public:
+	struct Options
+	{
+		int threads = 0;					// 0 = one per hardware thread
+		size_t chunk_size = 1 << 20;		// bytes read from the file at a time
+		int batch_size = 64;				// games handed to a worker at a time
+		int max_errors = 20;				// malformed games kept for the report
+	};
+
+	struct GameError
+	{
+		U64 game;		// 1-based position of the game in the file
+		std::string message;
+	};
+
+	struct Summary
+	{
+		U64 games = 0;
+		U64 valid = 0;
+		U64 malformed = 0;
+		U64 plies = 0;
+		double seconds = 0.0;
+		bool opened = false;
+		std::vector<GameError> errors;	// sorted by game
+	};
+
+	static Summary run(const std::string& path, const Options& options);
+	static void print_summary(const Summary& summary, std::ostream& out);
+
+	// Replays one game (tags and movetext). Returns false with error set on the first problem.
+	static bool replay(const std::string& text, U64& plies, std::string& error);
+
+private:
+	struct Batch
+	{
+		U64 first_game;
+		std::vector<std::string> games;
+	};
+
+	static bool is_result(const std::string& token);
+};
@@ -0,0 +1,119 @@
+#include "Profiler.h"
+
+#ifdef CHESS_PROFILE
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <cstdlib>
+
+namespace
+{
+	std::mutex totals_mutex;
+	Profiler::Counters exited;
+
+	// converts ticks to nanoseconds from the tick rate observed over the whole run
+	struct Clock
+	{
+		std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+		unsigned long long start_ticks = Profiler::ticks();
+
+		double ns_per_tick() const
+		{
+			double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count());
+			unsigned long long elapsed = Profiler::ticks() - start_ticks;
+			return elapsed ? ns / double(elapsed) : 1.0;
+		}
+	};
+
+	Clock run_clock;
+
+	// every thread, the main one included, has exited and been folded in by the time this runs
+	struct Reporter
+	{
+		~Reporter()
+		{
+			std::lock_guard<std::mutex> lock(totals_mutex);
+			const char* path = std::getenv("CHESS_PROFILE_JSON");
+			if (path)
+			{
+				std::ofstream file(path);
+				Profiler::dump_json(file, exited);
+			}
+			else
+			{
+				Profiler::dump_table(std::cerr, exited);
+			}
+		}
+	};
+
+	// constructed after run_clock, so it is destroyed (and reports) before it
+	Reporter reporter;
+}
+
+const char* const Profiler::scope_names[scope_count]
+{
+	"moves",
+	"all_legal_moves",
+	"king_moves",
+	"attacks",
+	"sliding_attacks",
+	"make_move",
+	"update_game_status"
+};
+
+Profiler::ThreadCounters::~ThreadCounters()
+{
+	std::lock_guard<std::mutex> lock(totals_mutex);
+	for (int scope = 0; scope < scope_count; scope++)
+	{
+		exited.calls[scope] += calls[scope];
+		exited.ticks[scope] += ticks[scope];
+	}
+}
+
+Profiler::Counters Profiler::totals()
+{
+	std::lock_guard<std::mutex> lock(totals_mutex);
+	Counters result;
+	Counters& current = local();
+	for (int scope = 0; scope < scope_count; scope++)
+	{
+		result.calls[scope] = exited.calls[scope] + current.calls[scope];
+		result.ticks[scope] = exited.ticks[scope] + current.ticks[scope];
+	}
+	return result;
+}
+
+void Profiler::dump_table(std::ostream& out, const Counters& counters)
+{
+	double ns_per_tick = run_clock.ns_per_tick();
+
+	out << std::left << std::setw(22) << "scope" << std::right << std::setw(16) << "calls" << std::setw(16) << "total ms" << std::setw(12) << "ns/call" << '\n';
+	for (int scope = 0; scope < scope_count; scope++)
+	{
+		double ns = double(counters.ticks[scope]) * ns_per_tick;
+		out << std::left << std::setw(22) << scope_names[scope] << std::right
+			<< std::setw(16) << counters.calls[scope]
+			<< std::setw(16) << std::fixed << std::setprecision(3) << ns / 1e6
+			<< std::setw(12) << std::setprecision(1) << (counters.calls[scope] ? ns / double(counters.calls[scope]) : 0.0) << '\n';
+	}
+}
+
+void Profiler::dump_json(std::ostream& out, const Counters& counters)
+{
+	double ns_per_tick = run_clock.ns_per_tick();
+
+	out << "{\n";
+	for (int scope = 0; scope < scope_count; scope++)
+	{
+		out << "  \"" << scope_names[scope] << "\": { \"calls\": " << counters.calls[scope]
+			<< ", \"ticks\": " << counters.ticks[scope]
+			<< ", \"ns\": " << std::fixed << std::setprecision(0) << double(counters.ticks[scope]) * ns_per_tick << " }"
+			<< (scope + 1 < scope_count ? "," : "") << '\n';
+	}
+	out << "}\n";
+}
+
+#endif
@@ -0,0 +1,95 @@
+#pragma once
+
+// Hot-path call counters and scoped timers.
+//
+// Build with CHESS_PROFILE defined to enable. Each thread counts into its own
+// block, which is folded into the process totals when the thread exits; the
+// totals are dumped when the program ends (as a table on stderr, or as JSON to
+// the file named by the CHESS_PROFILE_JSON environment variable).
+// Without CHESS_PROFILE the PROFILE_SCOPE macro expands to nothing.
+
+#ifdef CHESS_PROFILE
+
+#include <chrono>
+#include <ostream>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+class Profiler
+{
+public:
+	const enum enumScope
+	{
+		MOVES,
+		ALL_LEGAL_MOVES,
+		KING_MOVES,
+		ATTACKS,
+		SLIDING_ATTACKS,
+		MAKE_MOVE,
+		UPDATE_GAME_STATUS,
+		scope_count
+	};
+
+	const static char* const scope_names[scope_count];
+
+	struct Counters
+	{
+		unsigned long long calls[scope_count]{};
+		unsigned long long ticks[scope_count]{};
+	};
+
+	// per-thread block, folded into the process totals when its thread exits
+	struct ThreadCounters : Counters
+	{
+		~ThreadCounters();
+	};
+
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(enumScope scope) : scope(scope), start(ticks()) {}
+		~ScopedTimer()
+		{
+			Counters& counters = local();
+			counters.calls[scope]++;
+			counters.ticks[scope] += ticks() - start;
+		}
+
+	private:
+		enumScope scope;
+		unsigned long long start;
+	};
+
+	inline static unsigned long long ticks()
+	{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	inline static Counters& local()
+	{
+		thread_local ThreadCounters counters;
+		return counters;
+	}
+
+	// totals of every thread that has exited so far, plus the calling thread
+	static Counters totals();
+	static void dump_table(std::ostream& out, const Counters& counters);
+	static void dump_json(std::ostream& out, const Counters& counters);
+	inline static void dump_table(std::ostream& out) { dump_table(out, totals()); }
+	inline static void dump_json(std::ostream& out) { dump_json(out, totals()); }
+};
+
+#define PROFILE_SCOPE(scope) Profiler::ScopedTimer profile_scope(Profiler::scope)
+
+#else
+
+#define PROFILE_SCOPE(scope)
+
+#endif
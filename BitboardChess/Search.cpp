@@ -0,0 +1,614 @@
+#include "Search.h"
+#include "Bitbase.h"
+#include <algorithm>
+#include <cstdlib>
+
+const int Search::piece_value[8] { 0, 0, 100, 500, 320, 330, 900, 0 };
+
+namespace
+{
+	// piece-square bonuses from white's point of view, a1 first
+	const int pawn_table[64]
+	{
+		 0,  0,  0,  0,  0,  0,  0,  0,
+		 5, 10, 10,-20,-20, 10, 10,  5,
+		 5, -5,-10,  0,  0,-10, -5,  5,
+		 0,  0,  0, 20, 20,  0,  0,  0,
+		 5,  5, 10, 25, 25, 10,  5,  5,
+		10, 10, 20, 30, 30, 20, 10, 10,
+		50, 50, 50, 50, 50, 50, 50, 50,
+		 0,  0,  0,  0,  0,  0,  0,  0
+	};
+
+	const int knight_table[64]
+	{
+		-50,-40,-30,-30,-30,-30,-40,-50,
+		-40,-20,  0,  5,  5,  0,-20,-40,
+		-30,  5, 10, 15, 15, 10,  5,-30,
+		-30,  0, 15, 20, 20, 15,  0,-30,
+		-30,  5, 15, 20, 20, 15,  5,-30,
+		-30,  0, 10, 15, 15, 10,  0,-30,
+		-40,-20,  0,  0,  0,  0,-20,-40,
+		-50,-40,-30,-30,-30,-30,-40,-50
+	};
+
+	const int bishop_table[64]
+	{
+		-20,-10,-10,-10,-10,-10,-10,-20,
+		-10,  5,  0,  0,  0,  0,  5,-10,
+		-10, 10, 10, 10, 10, 10, 10,-10,
+		-10,  0, 10, 10, 10, 10,  0,-10,
+		-10,  5,  5, 10, 10,  5,  5,-10,
+		-10,  0,  5, 10, 10,  5,  0,-10,
+		-10,  0,  0,  0,  0,  0,  0,-10,
+		-20,-10,-10,-10,-10,-10,-10,-20
+	};
+
+	const int rook_table[64]
+	{
+		 0,  0,  0,  5,  5,  0,  0,  0,
+		-5,  0,  0,  0,  0,  0,  0, -5,
+		-5,  0,  0,  0,  0,  0,  0, -5,
+		-5,  0,  0,  0,  0,  0,  0, -5,
+		-5,  0,  0,  0,  0,  0,  0, -5,
+		-5,  0,  0,  0,  0,  0,  0, -5,
+		 5, 10, 10, 10, 10, 10, 10,  5,
+		 0,  0,  0,  0,  0,  0,  0,  0
+	};
+
+	const int queen_table[64]
+	{
+		-20,-10,-10, -5, -5,-10,-10,-20,
+		-10,  0,  5,  0,  0,  0,  0,-10,
+		-10,  5,  5,  5,  5,  5,  0,-10,
+		  0,  0,  5,  5,  5,  5,  0, -5,
+		 -5,  0,  5,  5,  5,  5,  0, -5,
+		-10,  0,  5,  5,  5,  5,  0,-10,
+		-10,  0,  0,  0,  0,  0,  0,-10,
+		-20,-10,-10, -5, -5,-10,-10,-20
+	};
+
+	const int king_table[64]
+	{
+		 20, 30, 10,  0,  0, 10, 30, 20,
+		 20, 20,  0,  0,  0,  0, 20, 20,
+		-10,-20,-20,-20,-20,-20,-20,-10,
+		-20,-30,-30,-40,-40,-30,-30,-20,
+		-30,-40,-40,-50,-50,-40,-40,-30,
+		-30,-40,-40,-50,-50,-40,-40,-30,
+		-30,-40,-40,-50,-50,-40,-40,-30,
+		-30,-40,-40,-50,-50,-40,-40,-30
+	};
+
+	const int* const piece_tables[8] { nullptr, nullptr, pawn_table, rook_table, knight_table, bishop_table, queen_table, king_table };
+
+	const int doubled_penalty = 12;
+	const int isolated_penalty = 15;
+	const int backward_penalty = 8;
+	const int passed_bonus[8] { 0, 5, 10, 20, 35, 60, 100, 0 };		// by rank, from the pawn's side
+	const int free_passer_bonus[8] { 0, 0, 5, 10, 20, 35, 60, 0 };	// stop square empty; depends on pieces, so not cached
+	const int shield_bonus[2] { 10, 5 };							// own pawns one and two ranks in front of the king
+
+	inline U64 north_fill(U64 bb)
+	{
+		bb |= bb << 8;
+		bb |= bb << 16;
+		return bb | bb << 32;
+	}
+
+	inline U64 south_fill(U64 bb)
+	{
+		bb |= bb >> 8;
+		bb |= bb >> 16;
+		return bb | bb >> 32;
+	}
+
+	inline int center_distance(int square)
+	{
+		int file = square & 7;
+		int rank = square >> 3;
+		return std::max(3 - file, file - 4) + std::max(3 - rank, rank - 4);
+	}
+
+	inline int square_distance(int square1, int square2)
+	{
+		return std::max(std::abs((square1 & 7) - (square2 & 7)), std::abs((square1 >> 3) - (square2 >> 3)));
+	}
+}
+
+void Search::evaluate_pawns(const ChessGame::Position& position, PawnEntry& entry)
+{
+	U64 pawns = position.pieces(ChessGame::nPawn);
+	U64 own[2] { pawns & position.pieces(ChessGame::nWhite), pawns & position.pieces(ChessGame::nBlack) };
+	U64 attacks[2] { ChessGame::pawn_attack_set<ChessGame::white>(own[0]), ChessGame::pawn_attack_set<ChessGame::black>(own[1]) };
+
+	// squares ahead of each side's pawns, and every square they could ever attack
+	U64 front[2] { north_fill(own[0] << 8), south_fill(own[1] >> 8) };
+	U64 attack_span[2] { north_fill(attacks[0]), south_fill(attacks[1]) };
+
+	int score[2] { 0, 0 };
+
+	for (int color = ChessGame::white; color <= ChessGame::black; color++)
+	{
+		U64 us = own[color];
+		U64 files = north_fill(south_fill(us));
+		U64 neighbours = ChessGame::east_one(files) | ChessGame::west_one(files);
+		U64 stops = color == ChessGame::white ? us << 8 : us >> 8;
+		U64 backward_stops = stops & attacks[!color] & ~attack_span[color];
+
+		U64 passed = us & ~(front[!color] | attack_span[!color]);
+		U64 doubled = us & front[color];
+		U64 isolated = us & ~neighbours;
+		U64 backward = color == ChessGame::white ? backward_stops >> 8 : backward_stops << 8;
+
+		score[color] -= doubled_penalty * ChessGame::pop_count(doubled) + isolated_penalty * ChessGame::pop_count(isolated) + backward_penalty * ChessGame::pop_count(backward);
+
+		for (U64 bb = passed; bb; bb &= bb - 1)
+		{
+			int rank = ChessGame::bit_scan_forward(bb) >> 3;
+			score[color] += passed_bonus[color == ChessGame::white ? rank : 7 - rank];
+		}
+
+		entry.passed[color] = passed;
+		entry.king_square[color] = ChessGame::no_square;
+	}
+
+	entry.key = position.pawn_key;
+	entry.score = score[ChessGame::white] - score[ChessGame::black];
+}
+
+int Search::pawn_shield(const ChessGame::Position& position, PawnEntry& entry, int color)
+{
+	int king_square = ChessGame::bit_scan_forward(position.pieces(ChessGame::nKing) & position.pieces(color));
+	if (entry.king_square[color] == king_square) return entry.shield[color];
+
+	U64 king = 1ULL << king_square;
+	U64 zone = king | ChessGame::east_one(king) | ChessGame::west_one(king);
+	U64 one = color == ChessGame::white ? zone << 8 : zone >> 8;
+	U64 two = color == ChessGame::white ? one << 8 : one >> 8;
+	U64 pawns = position.pieces(ChessGame::nPawn) & position.pieces(color);
+
+	entry.king_square[color] = (unsigned char)king_square;
+	entry.shield[color] = short(shield_bonus[0] * ChessGame::pop_count(pawns & one) + shield_bonus[1] * ChessGame::pop_count(pawns & two));
+	return entry.shield[color];
+}
+
+Search::PawnEntry& Search::probe_pawns(const ChessGame::Position& position)
+{
+	PawnEntry& entry = pawn_table[position.pawn_key & (pawn_table_size - 1)];
+
+	pawn_probes++;
+	if (entry.key == position.pawn_key) pawn_hits++;
+	else evaluate_pawns(position, entry);
+
+	return entry;
+}
+
+int Search::evaluate(const ChessGame::Position& position)
+{
+	PawnEntry pawns;
+	evaluate_pawns(position, pawns);
+	return evaluate(position, pawns);
+}
+
+int Search::evaluate(const ChessGame::Position& position, PawnEntry& pawns)
+{
+	int score = pawns.score + pawn_shield(position, pawns, ChessGame::white) - pawn_shield(position, pawns, ChessGame::black);
+
+	for (U64 bb = pawns.passed[ChessGame::white] & (position.empty_squares() >> 8); bb; bb &= bb - 1)
+	{
+		score += free_passer_bonus[ChessGame::bit_scan_forward(bb) >> 3];
+	}
+	for (U64 bb = pawns.passed[ChessGame::black] & (position.empty_squares() << 8); bb; bb &= bb - 1)
+	{
+		score -= free_passer_bonus[7 - (ChessGame::bit_scan_forward(bb) >> 3)];
+	}
+
+	for (int type = ChessGame::nPawn; type <= ChessGame::nKing; type++)
+	{
+		for (U64 bb = position.pieces(type) & position.pieces(ChessGame::nWhite); bb; bb &= bb - 1)
+		{
+			score += piece_value[type] + piece_tables[type][ChessGame::bit_scan_forward(bb)];
+		}
+		for (U64 bb = position.pieces(type) & position.pieces(ChessGame::nBlack); bb; bb &= bb - 1)
+		{
+			score -= piece_value[type] + piece_tables[type][ChessGame::bit_scan_forward(bb) ^ 56];
+		}
+	}
+
+	return position.color_to_move == ChessGame::white ? score : -score;
+}
+
+int Search::static_eval(const ChessGame::Position& position, int ply)
+{
+	if (!use_nnue) return evaluate(position, probe_pawns(position));
+
+	// keep the network clear of the known-win and mate bands
+	int score = Nnue::evaluate(position, accumulators[ply]);
+	return std::min(std::max(score, -known_win + 1), known_win - 1);
+}
+
+void Search::make_move(const ChessGame::Position& position, ChessGame::Position& next, ChessGame::Move move, int ply)
+{
+	next = position;
+
+	if (!use_nnue)
+	{
+		ChessGame::make_move(next, move.initial_square, move.final_square);
+		return;
+	}
+
+	ChessGame::DirtyPieces dirty;
+	ChessGame::make_move(next, move.initial_square, move.final_square, &dirty);
+	Nnue::update(accumulators[ply], accumulators[ply + 1], dirty);
+}
+
+// known results are scored past any material balance, with a mop-up term so the winning side makes progress
+int Search::bitbase_score(const ChessGame::Position& position, ChessGame::enumBitbaseResult result, int ply)
+{
+	if (result == ChessGame::BB_DRAW) return 0;
+
+	bool winner = (result == ChessGame::BB_WIN) == (position.color_to_move == ChessGame::black);
+	U64 kings = position.pieces(ChessGame::nKing);
+	int winner_king = ChessGame::bit_scan_forward(kings & position.pieces(winner));
+	int loser_king = ChessGame::bit_scan_forward(kings & position.pieces(!winner));
+
+	int score = known_win - ply + 20 * center_distance(loser_king) - 10 * square_distance(winner_king, loser_king);
+
+	U64 pawns = position.pieces(ChessGame::nPawn);
+	if (pawns)
+	{
+		int rank = ChessGame::bit_scan_forward(pawns) >> 3;
+		score += 20 * (winner == ChessGame::white ? rank : 7 - rank);
+	}
+
+	return result == ChessGame::BB_WIN ? score : -score;
+}
+
+int Search::piece_type(const ChessGame::Position& position, int square)
+{
+	U64 bb = 1ULL << square;
+	int type;
+	for (type = ChessGame::nPawn; type < ChessGame::nKing && !(position.pieces(type) & bb); type++);
+	return type;
+}
+
+// captures first, most valuable victim / least valuable attacker; order is stable otherwise
+void Search::order_moves(const ChessGame::Position& position, ChessGame::MoveList& list, int first)
+{
+	int keys[256];
+
+	for (int i = first; i < list.count; i++)
+	{
+		const ChessGame::Move& move = list.moves[i];
+		U64 to = 1ULL << move.final_square;
+		int key = 0;
+
+		if (to & ~position.empty_squares()) key = 10 * piece_value[piece_type(position, move.final_square)] - piece_value[piece_type(position, move.initial_square)] + 10000;
+		if ((position.pieces(ChessGame::nPawn) & (1ULL << move.initial_square)) && (to & (ChessGame::first_rank | ChessGame::eighth_rank))) key += 8000;
+
+		keys[i] = key;
+	}
+
+	for (int i = first + 1; i < list.count; i++)
+	{
+		ChessGame::Move move = list.moves[i];
+		int key = keys[i];
+		int j = i - 1;
+		for (; j >= first && keys[j] < key; j--)
+		{
+			list.moves[j + 1] = list.moves[j];
+			keys[j + 1] = keys[j];
+		}
+		list.moves[j + 1] = move;
+		keys[j + 1] = key;
+	}
+}
+
+void Search::clear()
+{
+	table.clear();
+}
+
+Search::Result Search::think(const ChessGame::Position& position, const Limits& limits)
+{
+	Result result;
+	nodes = 0;
+	node_limit = limits.nodes;
+	stopped = false;
+	pawn_probes = 0;
+	pawn_hits = 0;
+	cache_hits = 0;
+
+	// without a cache file the search keeps its own table, from one think() to the next
+	cache = nullptr;
+	if (limits.cache && limits.cache->is_open())
+	{
+		cache = limits.cache;
+	}
+	else if (limits.hash_mb > 0)
+	{
+		if (table_mb != limits.hash_mb) table.allocate(limits.hash_mb);
+		table_mb = limits.hash_mb;
+		cache = &table;
+	}
+	if (pawn_table.empty()) pawn_table.resize(pawn_table_size);
+
+	use_nnue = limits.nnue && Nnue::is_loaded();
+	evaluator_key = use_nnue ? Nnue::checksum() : 0x9E3779B97F4A7C15ULL * U64(eval_version);
+	if (use_nnue)
+	{
+		accumulators.resize(max_ply + 1);
+		Nnue::refresh(position, accumulators[0]);
+	}
+
+	// a warm cache answers the root up to the depth it was searched to, so start there
+	int first_depth = 1;
+	AnalysisCache::Hit hit;
+	if (cache && cache->probe(cache_key(position), hit) && hit.bound == AnalysisCache::EXACT) first_depth = std::max(1, std::min(hit.depth, limits.depth));
+
+	int pv_count = std::max(1, std::min(limits.multi_pv, int(max_pv)));
+
+	for (int depth = first_depth; depth <= limits.depth; depth++)
+	{
+		Line lines[max_pv];
+		int line_count = 0;
+		int score = 0;
+
+		// each further line searches the root again without the moves already listed;
+		// the table carries what the earlier lines found over to it
+		excluded_count = 0;
+		for (int k = 0; k < pv_count; k++)
+		{
+			ChessGame::Move best_move = k < result.line_count ? result.lines[k].moves[0] : ChessGame::Move{};
+			int line_score = negamax(position, depth, -infinity, infinity, 0, &best_move);
+
+			// a search cut short by the node limit is only trusted for the first line of the first iteration
+			if (stopped && (depth > first_depth || k > 0)) break;
+			if (!k) score = line_score;
+
+			// no moves left to list, or none at all when the root is mate or stalemate
+			if (!(best_move.initial_square | best_move.final_square)) break;
+
+			extract_line(position, best_move, lines[k]);
+			lines[k].score = line_score;
+			line_count++;
+			excluded[excluded_count++] = best_move;
+			if (stopped) break;
+		}
+		excluded_count = 0;
+
+		// an iteration stopped before any root move was searched has nothing to report, not even a score
+		if (stopped && (depth > first_depth || !line_count)) break;
+
+		for (int k = 0; k < line_count; k++) result.lines[k] = lines[k];
+		result.line_count = line_count;
+		result.best_move = line_count ? lines[0].moves[0] : ChessGame::Move{};
+		result.score = score;
+		result.depth = depth;
+
+		if (stopped || is_mate_score(result.score)) break;
+	}
+
+	// a node limit can stop the first iteration before the root has a move; any legal one beats
+	// none, and it goes out at depth 0 with the static score
+	if (!(result.best_move.initial_square | result.best_move.final_square))
+	{
+		ChessGame::MoveList list;
+		ChessGame::generate_moves(position, list);
+		if (list.count)
+		{
+			result.best_move = list.moves[0];
+			result.score = static_eval(position, 0);
+		}
+	}
+
+	result.nodes = nodes;
+	result.pawn_probes = pawn_probes;
+	result.pawn_hits = pawn_hits;
+	result.cache_hits = cache_hits;
+	return result;
+}
+
+int Search::negamax(const ChessGame::Position& position, int depth, int alpha, int beta, int ply, ChessGame::Move* best_move)
+{
+	if (node_limit && nodes >= node_limit) stopped = true;
+	if (stopped && ply > 0) return 0;
+
+	if (ply > 0)
+	{
+		ChessGame::enumBitbaseResult result = Bitbase::probe(position);
+		if (result != ChessGame::BB_UNKNOWN) return bitbase_score(position, result, ply);
+		if (position.halfmove_clock >= 100) return 0;
+	}
+
+	if (depth <= 0 || ply >= max_ply) return quiescence(position, alpha, beta, ply);
+
+	nodes++;
+
+	ChessGame::MoveList list;
+	ChessGame::generate_moves(position, list);
+
+	bool is_black = position.color_to_move;
+	bool in_check = position.pieces(ChessGame::nKing) & position.pieces(is_black) & position.attack_maps[!is_black];
+
+	if (!list.count) return in_check ? -mate_score + ply : 0;
+
+	// further multi-PV lines leave out the root moves already listed, and their root
+	// results are not the position's own, so the table is not used for them
+	bool use_table = cache && !(ply == 0 && excluded_count);
+	if (ply == 0 && excluded_count)
+	{
+		int count = 0;
+		for (int i = 0; i < list.count; i++)
+		{
+			bool listed = false;
+			for (int j = 0; j < excluded_count && !listed; j++) listed = list.moves[i].initial_square == excluded[j].initial_square && list.moves[i].final_square == excluded[j].final_square;
+			if (!listed) list.moves[count++] = list.moves[i];
+		}
+		list.count = count;
+
+		if (!count)
+		{
+			if (best_move) *best_move = ChessGame::Move{};
+			return -infinity;
+		}
+	}
+
+	// the previous iteration's best move goes first at the root, else the cached one
+	ChessGame::Move hash_move{};
+	if (best_move) hash_move = *best_move;
+
+	U64 key = 0ULL;
+	if (use_table)
+	{
+		key = cache_key(position);
+		AnalysisCache::Hit hit;
+		if (cache->probe(key, hit))
+		{
+			bool legal = false;
+			for (int i = 0; i < list.count && !legal; i++) legal = list.moves[i].initial_square == hit.move.initial_square && list.moves[i].final_square == hit.move.final_square;
+
+			int score = score_from_cache(hit.score, ply);
+			bool usable = hit.bound == AnalysisCache::EXACT || (hit.bound == AnalysisCache::LOWER_BOUND && score >= beta) || (hit.bound == AnalysisCache::UPPER_BOUND && score <= alpha);
+
+			// the root needs an exact score and a move to report
+			if (hit.depth >= depth && (ply > 0 ? usable : hit.bound == AnalysisCache::EXACT && legal))
+			{
+				cache_hits++;
+				if (best_move) *best_move = hit.move;
+				return score;
+			}
+			if (legal && !(hash_move.initial_square | hash_move.final_square)) hash_move = hit.move;
+		}
+	}
+
+	int first = 0;
+	if (hash_move.initial_square | hash_move.final_square)
+	{
+		for (int i = 0; i < list.count; i++)
+		{
+			if (list.moves[i].initial_square == hash_move.initial_square && list.moves[i].final_square == hash_move.final_square)
+			{
+				std::swap(list.moves[0], list.moves[i]);
+				first = 1;
+				break;
+			}
+		}
+	}
+	order_moves(position, list, first);
+
+	int best = -infinity;
+	int original_alpha = alpha;
+	ChessGame::Move node_best = list.moves[0];
+
+	for (int i = 0; i < list.count; i++)
+	{
+		ChessGame::Position next;
+		make_move(position, next, list.moves[i], ply);
+
+		int score = -negamax(next, depth - 1, -beta, -alpha, ply + 1, nullptr);
+
+		if (stopped)
+		{
+			if (ply > 0) return 0;
+			break;
+		}
+
+		if (score > best)
+		{
+			best = score;
+			node_best = list.moves[i];
+			if (best_move) *best_move = list.moves[i];
+		}
+
+		if (score > alpha) alpha = score;
+		if (alpha >= beta) break;
+	}
+
+	if (use_table && !stopped)
+	{
+		int bound = best <= original_alpha ? AnalysisCache::UPPER_BOUND : best >= beta ? AnalysisCache::LOWER_BOUND : AnalysisCache::EXACT;
+		cache->store(key, node_best, score_to_cache(best, ply), depth, bound);
+	}
+
+	return best;
+}
+
+void Search::extract_line(const ChessGame::Position& position, ChessGame::Move first, Line& line) const
+{
+	line.length = 0;
+	if (!(first.initial_square | first.final_square)) return;
+	line.moves[line.length++] = first;
+	if (!cache) return;
+
+	// follow the table's moves while they are legal
+	ChessGame::Position current = position;
+	ChessGame::make_move(current, first.initial_square, first.final_square);
+
+	while (line.length < max_line)
+	{
+		AnalysisCache::Hit hit;
+		if (!cache->probe(cache_key(current), hit)) break;
+
+		ChessGame::MoveList list;
+		ChessGame::generate_moves(current, list);
+
+		bool legal = false;
+		for (int i = 0; i < list.count && !legal; i++) legal = list.moves[i].initial_square == hit.move.initial_square && list.moves[i].final_square == hit.move.final_square;
+		if (!legal) break;
+
+		line.moves[line.length++] = hit.move;
+		ChessGame::make_move(current, hit.move.initial_square, hit.move.final_square);
+	}
+}
+
+int Search::quiescence(const ChessGame::Position& position, int alpha, int beta, int ply)
+{
+	nodes++;
+
+	if (ply >= max_ply) return static_eval(position, ply);
+
+	bool is_black = position.color_to_move;
+	bool in_check = position.pieces(ChessGame::nKing) & position.pieces(is_black) & position.attack_maps[!is_black];
+
+	ChessGame::MoveList list;
+	ChessGame::generate_moves(position, list);
+
+	if (!list.count) return in_check ? -mate_score + ply : 0;
+
+	int best = -infinity;
+
+	if (!in_check)
+	{
+		best = static_eval(position, ply);
+		if (best >= beta) return best;
+		if (best > alpha) alpha = best;
+
+		// only captures (and promotions) from here on
+		int count = 0;
+		for (int i = 0; i < list.count; i++)
+		{
+			U64 to = 1ULL << list.moves[i].final_square;
+			bool promotion = (position.pieces(ChessGame::nPawn) & (1ULL << list.moves[i].initial_square)) && (to & (ChessGame::first_rank | ChessGame::eighth_rank));
+			if ((to & ~position.empty_squares()) || promotion) list.moves[count++] = list.moves[i];
+		}
+		list.count = count;
+	}
+
+	order_moves(position, list);
+
+	for (int i = 0; i < list.count; i++)
+	{
+		ChessGame::Position next;
+		make_move(position, next, list.moves[i], ply);
+
+		int score = -quiescence(next, -beta, -alpha, ply + 1);
+
+		if (score > best) best = score;
+		if (score > alpha) alpha = score;
+		if (alpha >= beta) break;
+	}
+
+	return best;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "ChessGame.h"
+#include "Nnue.h"
+#include "AnalysisCache.h"
+#include <vector>
+
+// Alpha-beta searcher. One instance per thread; it owns all of its state.
+class Search
+{
+public:
+	struct Limits
+	{
+		int depth = 4;
+		U64 nodes = 0;	// 0 = no node limit
+		bool nnue = true;	// evaluate with the network when one is loaded
+		AnalysisCache* cache = nullptr;	// optional persistent cache, probed and written by the search
+		int hash_mb = 16;	// in-memory transposition table when no cache is given, 0 = none
+		int multi_pv = 1;	// best root moves to report, up to max_pv
+	};
+
+	const static int max_pv = 8;
+	const static int max_line = 16;
+
+	// a root move, its score and the moves after it as far as the table knows them
+	struct Line
+	{
+		ChessGame::Move moves[max_line]{};
+		int length = 0;
+		int score = 0;
+	};
+
+	struct Result
+	{
+		ChessGame::Move best_move{};
+		int score = 0;
+		int depth = 0;
+		Line lines[max_pv];	// best first; best_move and score repeat the first line
+		int line_count = 0;
+		U64 nodes = 0;
+		U64 pawn_probes = 0;
+		U64 pawn_hits = 0;
+		U64 cache_hits = 0;	// nodes answered by the analysis cache
+	};
+
+	// Pawn-structure terms depend on the pawns alone, so they are cached by Position::pawn_key.
+	// The king shield also depends on the king square, which is memoised per side in the entry.
+	// The all-zero entry is the pawnless structure, so empty slots need no marker.
+	struct PawnEntry
+	{
+		U64 key = 0ULL;
+		U64 passed[2]{};
+		int score = 0;				// white's point of view
+		short shield[2]{};
+		unsigned char king_square[2]{ ChessGame::no_square, ChessGame::no_square };
+	};
+
+	const static int infinity = 32767;
+	const static int mate_score = 32000;
+	const static int known_win = 20000;
+	const static int max_ply = 64;
+	const static int pawn_table_size = 16384;	// entries, a power of two
+	const static int eval_version = 1;			// raise whenever evaluate() scores differently
+
+	const static int piece_value[8];
+
+	Result think(const ChessGame::Position& position, const Limits& limits);
+	// forgets this search's own transposition table, as for a new game; a caller's cache is left alone
+	void clear();
+
+	// static evaluation from the side to move's point of view
+	static int evaluate(const ChessGame::Position& position);
+	static int evaluate(const ChessGame::Position& position, PawnEntry& pawns);
+	static void evaluate_pawns(const ChessGame::Position& position, PawnEntry& entry);
+
+	inline static bool is_mate_score(int score) { return score > mate_score - max_ply || score < -mate_score + max_ply; }
+
+private:
+	U64 nodes = 0;
+	U64 node_limit = 0;
+	bool stopped = false;
+	bool use_nnue = false;
+	U64 evaluator_key = 0ULL;
+
+	// accumulator per ply, alongside the search stack; children are derived from their parent's
+	std::vector<Nnue::Accumulator> accumulators;
+
+	// per-thread pawn hash table, kept from one think() to the next
+	std::vector<PawnEntry> pawn_table;
+	U64 pawn_probes = 0;
+	U64 pawn_hits = 0;
+
+	// the table in use: the caller's cache, or this search's own transposition table
+	AnalysisCache* cache = nullptr;
+	AnalysisCache table;
+	int table_mb = 0;
+	U64 cache_hits = 0;
+
+	// root moves already given a line in this iteration, left out of the next line's search
+	ChessGame::Move excluded[max_pv];
+	int excluded_count = 0;
+
+	int negamax(const ChessGame::Position& position, int depth, int alpha, int beta, int ply, ChessGame::Move* best_move);
+	int quiescence(const ChessGame::Position& position, int alpha, int beta, int ply);
+	int static_eval(const ChessGame::Position& position, int ply);
+	PawnEntry& probe_pawns(const ChessGame::Position& position);
+	void make_move(const ChessGame::Position& position, ChessGame::Position& next, ChessGame::Move move, int ply);
+	void extract_line(const ChessGame::Position& position, ChessGame::Move first, Line& line) const;
+
+	static void order_moves(const ChessGame::Position& position, ChessGame::MoveList& list, int first = 0);
+	static int piece_type(const ChessGame::Position& position, int square);
+	static int pawn_shield(const ChessGame::Position& position, PawnEntry& entry, int color);
+	static int bitbase_score(const ChessGame::Position& position, ChessGame::enumBitbaseResult result, int ply);
+
+	// results of another evaluator, another network or an older handcrafted evaluation keep
+	// apart from this one's in the cache, and so a persistent cache never answers with them
+	inline U64 cache_key(const ChessGame::Position& position) const { return ChessGame::position_key(position) ^ evaluator_key; }
+	// mate scores are stored as distance from the cached node, not from the root
+	inline static int score_to_cache(int score, int ply) { return score > mate_score - max_ply ? score + ply : score < -mate_score + max_ply ? score - ply : score; }
+	inline static int score_from_cache(int score, int ply) { return score > mate_score - max_ply ? score - ply : score < -mate_score + max_ply ? score + ply : score; }
+};
@@ -1,33 +1,447 @@
 
 #include "ChessGame.h"
+#include "Bitbase.h"
+#include "Nnue.h"
+#include "MatchRunner.h"
+#include "PgnImporter.h"
+#include "GameServer.h"
+#include "MateSolver.h"
+#include "Search.h"
+#include "AllocationCounter.h"
+#include "AnalysisCache.h"
+#include "Pgn.h"
+#include <fstream>
+#include <vector>
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <cstdlib>
+#include <algorithm>
 
-int main(int argc, char* argv[])
+// BitboardChess match [--games N] [--threads N] [--depth-a N] [--depth-b N] [--nodes-a N] [--nodes-b N]
+//                     [--nnue-a 0|1] [--nnue-b 0|1] [--openings file] [--pgn file] [--max-plies N]
+int run_match(int argc, char* argv[])
+{
+	MatchRunner::Options options;
+	std::string openings_path;
+
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		std::string flag = argv[i];
+		std::string value = argv[i + 1];
+
+		if (flag == "--games") options.games = std::atoi(value.c_str());
+		else if (flag == "--threads") options.threads = std::atoi(value.c_str());
+		else if (flag == "--depth-a") options.engine_limits[0].depth = std::atoi(value.c_str());
+		else if (flag == "--depth-b") options.engine_limits[1].depth = std::atoi(value.c_str());
+		else if (flag == "--nodes-a") options.engine_limits[0].nodes = std::strtoull(value.c_str(), nullptr, 10);
+		else if (flag == "--nodes-b") options.engine_limits[1].nodes = std::strtoull(value.c_str(), nullptr, 10);
+		else if (flag == "--nnue-a") options.engine_limits[0].nnue = std::atoi(value.c_str()) != 0;
+		else if (flag == "--nnue-b") options.engine_limits[1].nnue = std::atoi(value.c_str()) != 0;
+		else if (flag == "--openings") openings_path = value;
+		else if (flag == "--pgn") options.pgn_path = value;
+		else if (flag == "--max-plies") options.max_plies = std::atoi(value.c_str());
+		else std::cerr << "unknown option " << flag << std::endl;
+	}
+
+	if (!openings_path.empty()) options.openings = MatchRunner::load_openings(openings_path);
+	if (options.openings.empty())
+	{
+		for (int i = 0; MatchRunner::default_openings[i]; i++) options.openings.push_back(MatchRunner::default_openings[i]);
+	}
+
+	try
+	{
+		MatchRunner::print_summary(MatchRunner::run(options), std::cout);
+	}
+	catch (const std::exception& error)
+	{
+		std::cerr << "match aborted: " << error.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// BitboardChess pgn <file> [--threads N] [--chunk-kb N] [--batch N] [--errors N]
+int run_pgn(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		std::cerr << "usage: pgn <file> [--threads N] [--chunk-kb N] [--batch N] [--errors N]" << std::endl;
+		return 1;
+	}
+
+	PgnImporter::Options options;
+	std::string path = argv[2];
+
+	for (int i = 3; i + 1 < argc; i += 2)
+	{
+		std::string flag = argv[i];
+		std::string value = argv[i + 1];
+
+		if (flag == "--threads") options.threads = std::atoi(value.c_str());
+		else if (flag == "--chunk-kb") options.chunk_size = size_t(std::max(1, std::atoi(value.c_str()))) * 1024;
+		else if (flag == "--batch") options.batch_size = std::atoi(value.c_str());
+		else if (flag == "--errors") options.max_errors = std::atoi(value.c_str());
+		else std::cerr << "unknown option " << flag << std::endl;
+	}
+
+	PgnImporter::Summary summary = PgnImporter::run(path, options);
+	if (!summary.opened)
+	{
+		std::cerr << "cannot open " << path << std::endl;
+		return 1;
+	}
+
+	PgnImporter::print_summary(summary, std::cout);
+	return summary.malformed ? 2 : 0;
+}
+
+// BitboardChess server [--threads N]
+// BitboardChess server-bench [--threads N] [--sessions N] [--moves N]
+int run_server(int argc, char* argv[], bool load_test)
+{
+	int threads = 0;
+	int sessions = 1000;
+	int moves = 40;
+
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		std::string flag = argv[i];
+		std::string value = argv[i + 1];
+
+		if (flag == "--threads") threads = std::atoi(value.c_str());
+		else if (flag == "--sessions") sessions = std::atoi(value.c_str());
+		else if (flag == "--moves") moves = std::atoi(value.c_str());
+		else std::cerr << "unknown option " << flag << std::endl;
+	}
+
+	if (!load_test) return GameServer::run_stdio(threads);
+
+	GameServer::run_load_test(threads, sessions, moves, std::cout);
+	return 0;
+}
+
+// BitboardChess mate <epd file> [--moves N] [--nodes N] [--table-mb N]
+// BitboardChess mate --fen "<fen>" [--moves N] [--nodes N] [--table-mb N]
+int run_mate(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		std::cerr << "usage: mate <epd file> | --fen <fen> [--moves N] [--nodes N] [--table-mb N]" << std::endl;
+		return 1;
+	}
+
+	MateSolver::Limits limits;
+	std::string path = argv[2];
+	std::string fen;
+	int first_flag = 3;
+
+	if (path == "--fen" && argc > 3)
+	{
+		fen = argv[3];
+		path.clear();
+		first_flag = 4;
+	}
+
+	for (int i = first_flag; i + 1 < argc; i += 2)
+	{
+		std::string flag = argv[i];
+		std::string value = argv[i + 1];
+
+		if (flag == "--moves") limits.max_moves = std::atoi(value.c_str());
+		else if (flag == "--nodes") limits.nodes = std::strtoull(value.c_str(), nullptr, 10);
+		else if (flag == "--table-mb") limits.table_mb = std::atoi(value.c_str());
+		else std::cerr << "unknown option " << flag << std::endl;
+	}
+
+	if (fen.empty())
+	{
+		if (MateSolver::run_epd(path, limits, std::cout)) return 0;
+		std::cerr << "cannot open " << path << std::endl;
+		return 1;
+	}
+
+	const char* error = ChessGame::fen_error(fen);
+	if (error)
+	{
+		std::cerr << "bad FEN: " << error << std::endl;
+		return 1;
+	}
+
+	ChessGame::Position position = ChessGame::fen_to_pos(fen);
+	MateSolver solver;
+	MateSolver::Result result = solver.solve(position, limits);
+
+	if (result.solved) std::cout << "mate in " << result.mate_moves << ": " << MateSolver::line_to_san(position, result.line) << '\n';
+	else std::cout << (result.aborted ? "node limit reached\n" : "no mate found\n");
+	std::cout << result.nodes << " nodes, " << result.seconds * 1000.0 << " ms" << std::endl;
+	return result.solved ? 0 : 2;
+}
+
+// BitboardChess analyse <fen/epd file> [--depth N] [--nodes N] [--multipv N] [--hash-mb N] [--cache file] [--cache-mb N]
+// BitboardChess analyse --fen "<fen>" [--depth N] [--nodes N] [--multipv N] [--hash-mb N] [--cache file] [--cache-mb N]
+int run_analyse(int argc, char* argv[])
 {
-	ChessGame::Position random_position
+	if (argc < 3)
+	{
+		std::cerr << "usage: analyse <fen/epd file> | --fen <fen> [--depth N] [--nodes N] [--multipv N] [--hash-mb N] [--cache file] [--cache-mb N]" << std::endl;
+		return 1;
+	}
+
+	Search::Limits limits;
+	limits.depth = 6;
+	std::string path = argv[2];
+	std::string cache_path;
+	int cache_mb = 64;
+	std::vector<std::string> fens;
+	int first_flag = 3;
+
+	if (path == "--fen" && argc > 3)
+	{
+		fens.push_back(argv[3]);
+		first_flag = 4;
+	}
+
+	for (int i = first_flag; i + 1 < argc; i += 2)
+	{
+		std::string flag = argv[i];
+		std::string value = argv[i + 1];
+
+		if (flag == "--depth") limits.depth = std::atoi(value.c_str());
+		else if (flag == "--nodes") limits.nodes = std::strtoull(value.c_str(), nullptr, 10);
+		else if (flag == "--multipv") limits.multi_pv = std::atoi(value.c_str());
+		else if (flag == "--hash-mb") limits.hash_mb = std::atoi(value.c_str());
+		else if (flag == "--cache") cache_path = value;
+		else if (flag == "--cache-mb") cache_mb = std::atoi(value.c_str());
+		else std::cerr << "unknown option " << flag << std::endl;
+	}
+
+	if (fens.empty())
 	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			std::cerr << "cannot open " << path << std::endl;
+			return 1;
+		}
+
+		// the four position fields of a FEN or EPD line
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream fields(line);
+			std::string fen;
+			std::string field;
+			for (int i = 0; i < 4 && fields >> field; i++) fen += (i ? " " : "") + field;
+			if (!fen.empty() && fen[0] != '#') fens.push_back(fen + " 0 1");
+		}
+	}
+
+	AnalysisCache cache;
+	if (!cache_path.empty())
+	{
+		AnalysisCache::enumOpenResult opened = cache.open(cache_path, cache_mb);
+		if (opened != AnalysisCache::OPENED)
+		{
+			if (opened == AnalysisCache::NOT_A_CACHE) std::cerr << cache_path << ": not an analysis cache" << std::endl;
+			else std::cerr << "cannot map " << cache_path << std::endl;
+			return 1;
+		}
+		limits.cache = &cache;
+		std::cout << "cache " << cache_path << ": " << cache.size() << " entries\n";
+	}
+
+	Search search;
+	U64 nodes = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (const std::string& fen : fens)
+	{
+		const char* error = ChessGame::fen_error(fen);
+		if (error)
+		{
+			std::cout << fen << ": bad FEN: " << error << '\n';
+			continue;
+		}
+		ChessGame::Position position = ChessGame::fen_to_pos(fen);
+		ChessGame::update_attack_maps(position);
+
+		std::chrono::steady_clock::time_point position_start = std::chrono::steady_clock::now();
+		Search::Result result = search.think(position, limits);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - position_start).count();
+		nodes += result.nodes;
+
+		std::cout << fen << ": depth " << result.depth << " score " << result.score;
+		if (result.best_move.initial_square | result.best_move.final_square) std::cout << " best " << Pgn::move_to_san(position, result.best_move);
+		std::cout << "  [" << result.nodes << " nodes, " << result.cache_hits << " cache hits, " << ms << " ms]\n";
+
+		for (int k = 0; k < result.line_count; k++)
 		{
-			0x0000A0402008D580,
-			0xADA3500008000001,
-			0x00A370002000C500,
-			0x2100000000000080,
-			0x0000004008000000,
-			0x0400000000080000,
-			0x0800800000000001,
-			0x8000000000001000,
-		},
-		~(0x0000A0402008D580 | 0xADA3500008000001),
-		ChessGame::white
+			const Search::Line& line = result.lines[k];
+			std::vector<ChessGame::Move> moves(line.moves, line.moves + line.length);
+			std::cout << "  " << k + 1 << ". " << line.score << "  " << MateSolver::line_to_san(position, moves) << '\n';
+		}
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << fens.size() << " positions  time " << seconds << " s  nodes " << nodes << std::endl;
+	return 0;
+}
+
+// BitboardChess bench [--depth N] [--multipv N] [--hash-mb N] [--nnue 0|1]
+// Searches a fixed list of positions on one thread with a fresh search. The node total is a
+// signature of the search's behaviour: it only changes when the search or evaluation does.
+int run_bench(int argc, char* argv[])
+{
+	const char* const positions[] =
+	{
+		"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w - - 0 1",
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w - - 0 1",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		"r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b - - 0 1",
+		"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w - - 1 8",
+		"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+		"4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+		"r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+		"r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w - - 0 13",
+		"6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+		"3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+		"8/8/1p1k4/5ppp/PPK1p3/6P1/5PP1/8 b - - 0 1",
 	};
 
+	Search::Limits limits;
+	limits.depth = 6;
+	limits.nnue = false;
+
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		std::string flag = argv[i];
+		std::string value = argv[i + 1];
+
+		if (flag == "--depth") limits.depth = std::atoi(value.c_str());
+		else if (flag == "--multipv") limits.multi_pv = std::atoi(value.c_str());
+		else if (flag == "--hash-mb") limits.hash_mb = std::atoi(value.c_str());
+		else if (flag == "--nnue") limits.nnue = std::atoi(value.c_str()) != 0;
+		else std::cerr << "unknown option " << flag << std::endl;
+	}
+
+	Search search;
+	U64 nodes = 0;
+	int count = int(sizeof(positions) / sizeof(positions[0]));
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < count; i++)
+	{
+		ChessGame::Position position = ChessGame::fen_to_pos(positions[i]);
+		ChessGame::update_attack_maps(position);
+
+		Search::Result result = search.think(position, limits);
+		nodes += result.nodes;
+		std::cout << "position " << i + 1 << "/" << count << ": " << result.nodes << " nodes, score " << result.score << '\n';
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "depth " << limits.depth << ", multipv " << limits.multi_pv << ", " << (limits.nnue && Nnue::is_loaded() ? "nnue" : "handcrafted") << " evaluation\n";
+	std::cout << "time   " << seconds * 1000.0 << " ms\n";
+	std::cout << "nodes  " << nodes << "\n";
+	std::cout << "nps    " << U64(nodes / std::max(seconds, 1e-9)) << std::endl;
+	return 0;
+}
+
+// BitboardChess alloc-check [--perft N] [--depth N] [--fen "<fen>"]
+// Needs a build with CHESS_COUNT_ALLOCATIONS; fails if move generation, make-move, the
+// status update or the search touch the heap once their tables are set up.
+int run_alloc_check(int argc, char* argv[])
+{
+	if (!AllocationCounter::enabled)
+	{
+		std::cerr << "alloc-check needs a build with CHESS_COUNT_ALLOCATIONS defined" << std::endl;
+		return 1;
+	}
+
+	int perft_depth = 4;
+	Search::Limits limits;
+	limits.depth = 5;
+	std::string fen = "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		std::string flag = argv[i];
+		std::string value = argv[i + 1];
+
+		if (flag == "--perft") perft_depth = std::atoi(value.c_str());
+		else if (flag == "--depth") limits.depth = std::atoi(value.c_str());
+		else if (flag == "--fen") fen = value;
+		else std::cerr << "unknown option " << flag << std::endl;
+	}
+
+	ChessGame::Position position = ChessGame::fen_to_pos(fen);
+	ChessGame::update_attack_maps(position);
+
+	// the first think() sets up the search's tables; that is initialization, not the hot path
+	Search search;
+	search.think(position, limits);
+	ChessGame game(position);
+
+	unsigned long long before = AllocationCounter::count();
+	U64 leaves = ChessGame::perft(position, perft_depth) + ChessGame::perft(ChessGame::starting_position, perft_depth);
+	unsigned long long perft_allocations = AllocationCounter::count() - before;
+
+	before = AllocationCounter::count();
+	U64 nodes = 0;
+	for (int i = 0; i < 3; i++) nodes += search.think(i % 2 ? ChessGame::starting_position : position, limits).nodes;
+	unsigned long long search_allocations = AllocationCounter::count() - before;
+
+	// play the search's own moves through the game object, as the console loop does
+	before = AllocationCounter::count();
+	int plies = 0;
+	for (; plies < 40 && game.current_position.state != ChessGame::CHECKMATE && game.current_position.state != ChessGame::STALEMATE; plies++)
+	{
+		Search::Limits quick;
+		quick.depth = 2;
+		ChessGame::Move move = search.think(game.current_position, quick).best_move;
+		if (!(move.initial_square | move.final_square)) break;
+		game.make_move(move.initial_square, move.final_square);
+		game.update_game_status();
+	}
+	unsigned long long game_allocations = AllocationCounter::count() - before;
+
+	std::cout << "perft " << perft_depth << ": " << leaves << " leaves, " << perft_allocations << " allocations\n";
+	std::cout << "search depth " << limits.depth << ": " << nodes << " nodes, " << search_allocations << " allocations\n";
+	std::cout << "game: " << plies << " plies, " << game_allocations << " allocations" << std::endl;
+
+	return perft_allocations || search_allocations || game_allocations ? 2 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string random_fen = "r1bq1r1k/pp3p1p/4pPpQ/6N1/3n1P2/3B4/P1P1K1PP/q6R w - - 0 1";
+
 	std::string fen = "1rb2r1k/4bpRp/p2p4/3N1P1P/n2BP3/P3qP2/1PPpR3/1K5 w - - 0 24";
 	std::string stalemate_fen = "2Q2bnr/4p1pq/5pkr/7p/7P/4P3/PPPP1PP1/RNB1KBNR w KQ - 1 10";
 	std::string pin_fen = "7k/8/8/3q4/8/3Q4/3K4/8 w - - 0 1";
 
 	//ChessGame::Position position = ChessGame::fen_to_pos(stalemate_fen);
 
+	std::string mode = argc > 1 ? argv[1] : "";
+
+	// these modes never search; the server's stdout is its protocol stream
+	if (mode == "pgn") return run_pgn(argc, argv);
+	if (mode == "mate") return run_mate(argc, argv);
+	if (mode == "server" || mode == "server-bench") return run_server(argc, argv, mode == "server-bench");
+
+	Bitbase::init();
+
+	// the handcrafted evaluation is used when no network is present
+	if (Nnue::load("bitboard.nnue")) std::cout << "loaded bitboard.nnue\n";
+
+	if (mode == "match") return run_match(argc, argv);
+	if (mode == "analyse") return run_analyse(argc, argv);
+	if (mode == "bench") return run_bench(argc, argv);
+	if (mode == "alloc-check") return run_alloc_check(argc, argv);
+
 	ChessGame chess_game;
 
 	chess_game.start();